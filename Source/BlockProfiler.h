@@ -0,0 +1,297 @@
+/*
+  ==============================================================================
+
+    BlockProfiler.h
+
+    Per-block timing of the audio callback, compiled in only when
+    COMB_PROFILING is defined to 1.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#ifndef COMB_PROFILING
+ #define COMB_PROFILING 0
+#endif
+
+#if COMB_PROFILING
+ #include <algorithm>
+ #include <atomic>
+ #include <chrono>
+ #include <cmath>
+ #include <cstdint>
+ #include <cstdio>
+ #include <string>
+#endif
+
+//==============================================================================
+/**
+    Records how long each audio block takes, as histograms of the time per block
+    and of the deadline utilisation (time taken over the block's duration), plus
+    the most recent blocks as a trace.
+
+    Only the audio thread writes, and every counter is an atomic that it updates
+    with plain relaxed loads and stores, so recording a block costs two clock
+    reads and a handful of memory writes, with no locks or read-modify-write
+    instructions. Any other thread can read the counters at any time; a
+    snapshot taken mid-block may be one block out of step, which doesn't matter
+    for statistics. reset() is only a request, carried out by the audio thread
+    at the start of its next block.
+
+    Without COMB_PROFILING this is an empty class whose methods do nothing, so
+    the timing compiles away entirely.
+*/
+#if COMB_PROFILING
+class BlockProfiler
+{
+    using Clock = std::chrono::steady_clock;
+
+public:
+    static constexpr bool enabled = true;
+
+    /** Log-spaced block time bins, binsPerOctave to each doubling of nanoseconds. */
+    static constexpr int binsPerOctave = 4, numTimeBins = 32*binsPerOctave;
+
+    /** Utilisation bins of 1%, the last one collecting everything from 200% up. */
+    static constexpr int numLoadBins = 201;
+
+    /** The trace keeps this many of the most recent blocks. */
+    static constexpr int traceSize = 4096;
+
+    struct Stats
+    {
+        std::uint64_t numBlocks = 0, numSamples = 0;
+        double meanNs = 0, p50Ns = 0, p99Ns = 0, maxNs = 0, nsPerSample = 0;
+        double meanLoad = 0, p99Load = 0, maxLoad = 0;    // fractions of the block's duration
+    };
+
+    BlockProfiler() : origin (Clock::now()) {}
+
+    //==============================================================================
+    /** Times the block for as long as it's in scope. */
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer (BlockProfiler& p, int blockSamples, double blockSampleRate) noexcept
+            : profiler (p), numSamples (blockSamples), sampleRate (blockSampleRate), start (Clock::now())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            profiler.record (start, Clock::now(), numSamples, sampleRate);
+        }
+
+    private:
+        BlockProfiler& profiler;
+        const int numSamples;
+        const double sampleRate;
+        const Clock::time_point start;
+    };
+
+    /** Asks the audio thread to clear everything at its next block. */
+    void reset() noexcept     { resetRequested.store (true, std::memory_order_relaxed); }
+
+    //==============================================================================
+    Stats getStats() const noexcept
+    {
+        Stats stats;
+        stats.numBlocks = numBlocks.load (std::memory_order_relaxed);
+        stats.numSamples = numSamples.load (std::memory_order_relaxed);
+
+        if (stats.numBlocks == 0)
+            return stats;
+
+        const double totalNs = (double) totalNanoseconds.load (std::memory_order_relaxed);
+        stats.meanNs = totalNs/(double) stats.numBlocks;
+        stats.maxNs = (double) maxNanoseconds.load (std::memory_order_relaxed);
+        stats.nsPerSample = totalNs/(double) std::max<std::uint64_t> (1, stats.numSamples);
+        stats.p50Ns = std::min (stats.maxNs, getBinTime (findPercentile (timeBins, numTimeBins, 0.5)));
+        stats.p99Ns = std::min (stats.maxNs, getBinTime (findPercentile (timeBins, numTimeBins, 0.99)));
+
+        stats.meanLoad = (double) totalLoadPpm.load (std::memory_order_relaxed)*1.0e-6/(double) stats.numBlocks;
+        stats.maxLoad = (double) maxLoadPpm.load (std::memory_order_relaxed)*1.0e-6;
+        stats.p99Load = std::min (stats.maxLoad, (findPercentile (loadBins, numLoadBins, 0.99) + 1)*0.01);
+        return stats;
+    }
+
+    /** The statistics and both histograms, as JSON. */
+    std::string toJson() const
+    {
+        const auto stats = getStats();
+        std::string json = "{\n";
+        char line[256];
+
+        std::snprintf (line, sizeof (line), "  \"blocks\": %llu,\n  \"samples\": %llu,\n", (unsigned long long) stats.numBlocks, (unsigned long long) stats.numSamples);
+        json += line;
+        std::snprintf (line, sizeof (line), "  \"ns\": { \"mean\": %.0f, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f, \"perSample\": %.3f },\n",
+                       stats.meanNs, stats.p50Ns, stats.p99Ns, stats.maxNs, stats.nsPerSample);
+        json += line;
+        std::snprintf (line, sizeof (line), "  \"load\": { \"mean\": %.5f, \"p99\": %.5f, \"max\": %.5f },\n", stats.meanLoad, stats.p99Load, stats.maxLoad);
+        json += line;
+
+        // non-empty bins only, keyed by their lower edge
+        json += "  \"blockNsHistogram\": {";
+        appendBins (json, timeBins, numTimeBins, [] (int bin) { return getBinTime (bin - 1); });
+        json += " },\n  \"loadPercentHistogram\": {";
+        appendBins (json, loadBins, numLoadBins, [] (int bin) { return (double) bin; });
+        json += " }\n}\n";
+        return json;
+    }
+
+    /** The most recent blocks in Chrome's trace event format (load it in
+        chrome://tracing or Perfetto), one complete event per block.
+    */
+    std::string toChromeTrace() const
+    {
+        const auto end = traceWrite.load (std::memory_order_acquire);
+        const auto count = std::min<std::uint64_t> (end, traceSize);
+        std::string json = "{ \"traceEvents\": [\n";
+        char line[256];
+
+        for (auto i = end - count; i < end; ++i)
+        {
+            const auto& event = trace[i % traceSize];
+            std::snprintf (line, sizeof (line), "  { \"name\": \"processBlock\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"samples\": %d } }%s\n",
+                           (double) event.startNs.load (std::memory_order_relaxed)*1.0e-3,
+                           (double) event.durationNs.load (std::memory_order_relaxed)*1.0e-3,
+                           event.numSamples.load (std::memory_order_relaxed),
+                           i + 1 < end ? "," : "");
+            json += line;
+        }
+
+        json += "], \"displayTimeUnit\": \"ns\" }\n";
+        return json;
+    }
+
+private:
+    struct TraceEvent
+    {
+        std::atomic<std::int64_t> startNs { 0 }, durationNs { 0 };
+        std::atomic<int> numSamples { 0 };
+    };
+
+    template <typename Type>
+    static void increment (std::atomic<Type>& counter, Type amount = 1) noexcept
+    {
+        // there's only one writer, so this doesn't need to be an atomic add
+        counter.store (counter.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static int getTimeBin (std::int64_t ns) noexcept
+    {
+        if (ns <= 1)
+            return 0;
+
+        return std::min (numTimeBins - 1, (int) (std::log2 ((double) ns)*binsPerOctave));
+    }
+
+    /** Upper edge of a time bin. */
+    static double getBinTime (int bin) noexcept     { return std::exp2 ((double) (bin + 1)/binsPerOctave); }
+
+    template <typename Bins>
+    static int findPercentile (const Bins& bins, int numBins, double fraction) noexcept
+    {
+        std::uint64_t total = 0;
+        for (int i = 0; i < numBins; ++i)
+            total += bins[i].load (std::memory_order_relaxed);
+
+        const auto threshold = (std::uint64_t) std::ceil ((double) total*fraction);
+        std::uint64_t count = 0;
+
+        for (int i = 0; i < numBins; ++i)
+            if ((count += bins[i].load (std::memory_order_relaxed)) >= threshold && count > 0)
+                return i;
+
+        return numBins - 1;
+    }
+
+    template <typename Bins, typename EdgeFunction>
+    static void appendBins (std::string& json, const Bins& bins, int numBins, EdgeFunction getLowerEdge)
+    {
+        char entry[64];
+        const char* separator = " ";
+
+        for (int i = 0; i < numBins; ++i)
+        {
+            if (const auto count = bins[i].load (std::memory_order_relaxed))
+            {
+                std::snprintf (entry, sizeof (entry), "%s\"%.0f\": %u", separator, getLowerEdge (i), (unsigned) count);
+                json += entry;
+                separator = ", ";
+            }
+        }
+    }
+
+    void clear() noexcept
+    {
+        for (auto& bin : timeBins)      bin.store (0, std::memory_order_relaxed);
+        for (auto& bin : loadBins)      bin.store (0, std::memory_order_relaxed);
+
+        numBlocks.store (0, std::memory_order_relaxed);
+        numSamples.store (0, std::memory_order_relaxed);
+        totalNanoseconds.store (0, std::memory_order_relaxed);
+        maxNanoseconds.store (0, std::memory_order_relaxed);
+        totalLoadPpm.store (0, std::memory_order_relaxed);
+        maxLoadPpm.store (0, std::memory_order_relaxed);
+        traceWrite.store (0, std::memory_order_release);
+    }
+
+    void record (Clock::time_point start, Clock::time_point end, int blockSamples, double sampleRate) noexcept
+    {
+        // a plain load on every block, and a store only when a reset is due. A
+        // request arriving in between is served by the clear() that follows
+        if (resetRequested.load (std::memory_order_relaxed))
+        {
+            resetRequested.store (false, std::memory_order_relaxed);
+            clear();
+        }
+
+        const std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count();
+        const double deadlineNs = sampleRate > 0.0 ? (double) blockSamples*1.0e9/sampleRate : 0.0;
+        const auto loadPpm = (std::uint64_t) (deadlineNs > 0.0 ? (double) ns*1.0e6/deadlineNs : 0.0);
+
+        increment (timeBins[getTimeBin (ns)], 1u);
+        increment (loadBins[std::min<std::uint64_t> (numLoadBins - 1, loadPpm/10000)], 1u);
+        increment (numBlocks, (std::uint64_t) 1);
+        increment (numSamples, (std::uint64_t) std::max (0, blockSamples));
+        increment (totalNanoseconds, (std::uint64_t) ns);
+        increment (totalLoadPpm, loadPpm);
+
+        if ((std::uint64_t) ns > maxNanoseconds.load (std::memory_order_relaxed))
+            maxNanoseconds.store ((std::uint64_t) ns, std::memory_order_relaxed);
+
+        if (loadPpm > maxLoadPpm.load (std::memory_order_relaxed))
+            maxLoadPpm.store (loadPpm, std::memory_order_relaxed);
+
+        const auto index = traceWrite.load (std::memory_order_relaxed);
+        auto& event = trace[index % traceSize];
+        event.startNs.store (std::chrono::duration_cast<std::chrono::nanoseconds> (start - origin).count(), std::memory_order_relaxed);
+        event.durationNs.store (ns, std::memory_order_relaxed);
+        event.numSamples.store (blockSamples, std::memory_order_relaxed);
+        traceWrite.store (index + 1, std::memory_order_release);
+    }
+
+    const Clock::time_point origin;
+    std::atomic<bool> resetRequested { false };
+    std::atomic<unsigned> timeBins[numTimeBins] = {}, loadBins[numLoadBins] = {};
+    std::atomic<std::uint64_t> numBlocks { 0 }, numSamples { 0 }, totalNanoseconds { 0 }, maxNanoseconds { 0 };
+    std::atomic<std::uint64_t> totalLoadPpm { 0 }, maxLoadPpm { 0 }, traceWrite { 0 };
+    TraceEvent trace[traceSize];
+};
+#else
+class BlockProfiler
+{
+public:
+    static constexpr bool enabled = false;
+
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer (BlockProfiler&, int, double) noexcept {}
+    };
+
+    void reset() noexcept {}
+};
+#endif
@@ -0,0 +1,507 @@
+/*
+  ==============================================================================
+
+    CombBank.h
+
+    Many universal combs in one processor, in parallel and series sections, for
+    reverbs and resonator banks. Like CombEngine, free of any JUCE plumbing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "DelayLine.h"
+#include "FloatVector.h"
+
+//==============================================================================
+/** Most stages one CombBank can run. */
+static constexpr int maxCombStages = 32;
+
+/**
+    One universal comb in a bank: CombEngine's filter without the modulation,
+    xh[n] = x[n] + fb*xh[n - M] and y[n] = bl*xh[n] + ff*xh[n - M]. With ff = 1
+    and bl = -fb it is a Schroeder allpass. The delay is in seconds.
+*/
+struct CombStage
+{
+    float delay       = 0.03f;
+    float feedforward = 1.0f;
+    float feedback    = 0.0f;
+    float bleed       = 0.0f;
+    bool series       = false;    // starts a new section, fed by the previous one, instead of joining it
+};
+
+/**
+    The stages of a CombBank and how they're connected. The stages run in
+    sections: every stage in a section takes the same input, the section's
+    output is the average of theirs, and each section feeds the next one. A
+    stage with series set starts a new section, so a Schroeder reverb is its
+    parallel combs followed by one series stage for each allpass.
+*/
+struct CombBankParameters
+{
+    int numStages = 0;
+    CombStage stages[maxCombStages];
+    float mix = 1.0f;             // 0 passes the input straight through, 1 is only the bank
+
+    /** Adds a stage at the end, unless the bank is full. */
+    void addStage (const CombStage& stage) noexcept
+    {
+        if (numStages < maxCombStages)
+            stages[numStages++] = stage;
+    }
+
+    /** The longest delay of any stage, in seconds. */
+    float getMaxDelay() const noexcept
+    {
+        float longest = 0.0f;
+
+        for (int i = 0; i < numStages; ++i)
+            longest = std::max (longest, stages[i].delay);
+
+        return longest;
+    }
+};
+
+//==============================================================================
+/** The ready-made arrangements behind the plugin's bank menu. */
+enum class CombBankLayout
+{
+    off,
+    reverb,         // eight parallel combs into four series allpasses
+    resonator,      // sixteen parallel combs on the harmonics of one note
+    numLayouts
+};
+
+/** Builds one of the ready-made layouts. size (0 to 1) sets the room size or
+    the note, decay (0 to 1) how long the combs ring, and mix is as in
+    CombBankParameters. off gives an empty bank.
+*/
+inline CombBankParameters makeCombBank (CombBankLayout layout, float size, float decay, float mix) noexcept
+{
+    CombBankParameters bank;
+    bank.mix = mix;
+    size = std::min (std::max (size, 0.0f), 1.0f);
+
+    const float feedback = 0.98f*std::min (std::max (decay, 0.0f), 1.0f);
+
+    switch (layout)
+    {
+        case CombBankLayout::reverb:
+        {
+            // Freeverb's tunings in ms, chosen not to share echoes. The combs
+            // scale with the room and the allpasses stay as they are
+            static constexpr float combDelays[] = { 25.31f, 26.94f, 28.96f, 30.75f, 32.24f, 33.81f, 35.31f, 36.67f };
+            static constexpr float allpassDelays[] = { 12.61f, 10.00f, 7.73f, 5.10f };
+            const float scale = 0.001f*(0.3f + 1.4f*size);
+
+            for (auto delay : combDelays)
+                bank.addStage ({ delay*scale, 1.0f, feedback, 0.0f, false });
+
+            for (auto delay : allpassDelays)
+                bank.addStage ({ delay*0.001f, 1.0f, 0.5f, -0.5f, true });
+
+            break;
+        }
+
+        case CombBankLayout::resonator:
+        {
+            // a comb rings at every multiple of 1/delay, so stage k reinforces
+            // every kth harmonic of a note from 55 Hz (size 0) to 880 Hz (size 1)
+            const float fundamental = 55.0f*std::exp2 (4.0f*size);
+
+            for (int k = 1; k <= 16; ++k)
+                bank.addStage ({ 1.0f/(fundamental*(float) k), 1.0f, feedback, 0.0f, false });
+
+            break;
+        }
+
+        case CombBankLayout::off:
+        case CombBankLayout::numLayouts:
+        default:
+            break;
+    }
+
+    return bank;
+}
+
+//==============================================================================
+/**
+    Runs a CombBankParameters bank over a multichannel buffer, in place.
+
+    The stages are laid out structure-of-arrays: each coefficient is an array
+    with one lane per stage, and each section starts on a whole SimdVector, so
+    a vector operation advances four stages of a section at once. A section of
+    one stage still takes a whole vector, with the spare lanes' coefficients at
+    0. Every channel's lanes share one interleaved DelayLine, one contiguous
+    allocation aligned to a cache line for all the stages' delay lines, with
+    one write per sample for the whole bank. Since each stage's tap is at its
+    own delay, the taps are gathered: the offsets of every lane's taps are
+    worked out once a sample for all the channels, and each vector's four taps
+    are loaded straight into its lanes.
+
+    The delays are read with linear interpolation, and all the coefficients
+    ramp over rampSeconds when they change. Changing how the stages are
+    grouped (their number or the sections) clears the delay line, unless
+    nothing has been written since prepare() or reset(), and jumps straight to
+    the new settings instead.
+
+    prepare() allocates for a number of lanes per channel (see getNumLanes())
+    and a longest delay. Stages that don't fit are left out, and delays are
+    limited to the maximum.
+*/
+template <typename SampleType>
+class CombBank
+{
+public:
+    using Vector = SimdVector<SampleType>;
+
+    /** Time taken for the coefficients and the mix to reach a new value. */
+    static constexpr double rampSeconds = 0.02;
+
+    /** Level (about -100 dBFS) that the tail length decays to. */
+    static constexpr double silenceThreshold = 1.0e-5;
+
+    /** How long the bank keeps producing output after its input stops: the
+        longest ring in each section, added up along the series. Infinite if any
+        stage's feedback gain is 1.
+    */
+    static double getTailLengthSeconds (const CombBankParameters& p) noexcept
+    {
+        double total = 0.0, section = 0.0;
+
+        for (int i = 0; i < std::min (p.numStages, maxCombStages); ++i)
+        {
+            const auto& stage = p.stages[i];
+            const double feedback = std::abs ((double) stage.feedback);
+
+            if (stage.series)
+            {
+                total += section;
+                section = 0.0;
+            }
+
+            if (feedback >= 1.0)
+                return std::numeric_limits<double>::infinity();
+
+            const double ring = feedback > 0.0 ? (double) stage.delay*(1.0 + std::ceil (std::log (silenceThreshold)/std::log (feedback)))
+                                               : (double) stage.delay;
+            section = std::max (section, ring);
+        }
+
+        return p.mix > 0.0f ? total + section : 0.0;
+    }
+
+    /** Lanes each channel needs for p, with every section rounded up to whole vectors. */
+    static int getNumLanes (const CombBankParameters& p) noexcept
+    {
+        int numLanes = 0, sectionSize = 0;
+
+        for (int i = 0; i < std::min (p.numStages, maxCombStages); ++i)
+        {
+            if (i > 0 && p.stages[i].series)
+            {
+                numLanes += roundUpToVectors (sectionSize);
+                sectionSize = 0;
+            }
+
+            ++sectionSize;
+        }
+
+        return numLanes + roundUpToVectors (sectionSize);
+    }
+
+    //==============================================================================
+    /** Allocates room for maxLanes lanes per channel (see getNumLanes()) and
+        delays of up to maxDelaySeconds, and clears the bank.
+    */
+    void prepare (double newSampleRate, int newNumChannels, int maxLanes, double maxDelaySeconds)
+    {
+        sampleRate = newSampleRate;
+        numChannels = std::max (1, newNumChannels);
+        lanesPerChannel = roundUpToVectors (std::min (std::max (1, maxLanes), maxLanesPerChannel));
+        maxDelaySamples = (float) std::max (1.0, maxDelaySeconds*sampleRate);
+        rampLength = std::max (1, (int) (rampSeconds*sampleRate));
+
+        // one older tap past the longest delay, and never the frame being written
+        delayLine.setSize (numChannels*lanesPerChannel, (int) maxDelaySamples + 2);
+
+        for (int c = 0; c < numCoefficients; ++c)
+        {
+            current[c].assign ((size_t) lanesPerChannel, SampleType());
+            target[c].assign ((size_t) lanesPerChannel, SampleType());
+            step[c].assign ((size_t) lanesPerChannel, SampleType());
+        }
+
+        readOffsets.assign ((size_t) lanesPerChannel, 2);
+        fractions.assign ((size_t) lanesPerChannel, SampleType());
+        numSections = 0;
+        reset();
+    }
+
+    /** Clears the delay lines, and jumps to the parameters on the next process(). */
+    void reset() noexcept
+    {
+        delayLine.clear();
+        writeIndex = 0;
+        snapRamps = true;
+        delayLineClear = true;
+    }
+
+    /** Takes effect from the next process(). */
+    void setParameters (const CombBankParameters& newParams) noexcept     { params = newParams; }
+    const CombBankParameters& getParameters() const noexcept             { return params; }
+
+    /** Runs the bank over numSamples of the first numChannelsToProcess channels.
+        Any channels prepared beyond those carry on with silence.
+    */
+    void process (SampleType* const* channels, int numChannelsToProcess, int numSamples) noexcept
+    {
+        updateTargets();
+        processSamples (channels, std::min (numChannelsToProcess, numChannels), numSamples);
+    }
+
+private:
+    //==============================================================================
+    enum Coefficient { delayCoefficient, feedforwardCoefficient, feedbackCoefficient, bleedCoefficient, numCoefficients };
+
+    struct Section
+    {
+        int firstLane = 0, numVectors = 0, numStages = 0;
+    };
+
+    /** Every stage in a section of its own. */
+    static constexpr int maxLanesPerChannel = maxCombStages*Vector::size;
+
+    static int roundUpToVectors (int numLanes) noexcept     { return (numLanes + Vector::size - 1)/Vector::size*Vector::size; }
+
+    /** Lays the stages out in lanes and sets the coefficients' targets, starting
+        ramps to them, or jumping there if the sections have changed.
+    */
+    void updateTargets() noexcept
+    {
+        Section newSections[maxCombStages];
+        int numNewSections = 0, lane = 0;
+
+        for (int i = 0; i < std::min (params.numStages, maxCombStages); ++i)
+        {
+            if (numNewSections == 0 || params.stages[i].series)
+            {
+                if (numNewSections > 0)
+                    lane += newSections[numNewSections - 1].numVectors*Vector::size;
+
+                newSections[numNewSections++] = { lane, 0, 0 };
+            }
+
+            auto& section = newSections[numNewSections - 1];
+            stageLanes[i] = -1;
+
+            if (lane + section.numStages >= lanesPerChannel)
+                continue;
+
+            section.numVectors = roundUpToVectors (section.numStages + 1)/Vector::size;
+            stageLanes[i] = lane + section.numStages++;
+        }
+
+        // sections with no room left at all are dropped, along with everything after them
+        while (numNewSections > 0 && newSections[numNewSections - 1].numStages == 0)
+            --numNewSections;
+
+        bool regrouped = numNewSections != numSections;
+
+        for (int s = 0; s < numNewSections && ! regrouped; ++s)
+            regrouped = newSections[s].numStages != sections[s].numStages;
+
+        if (regrouped)
+        {
+            std::copy (newSections, newSections + numNewSections, sections);
+            numSections = numNewSections;
+            snapRamps = true;
+
+            if (! delayLineClear)
+                delayLine.clear();
+        }
+
+        // spare lanes read one sample back and contribute nothing
+        SampleType newTargets[numCoefficients][maxLanesPerChannel];
+
+        for (int l = 0; l < lanesPerChannel; ++l)
+        {
+            newTargets[delayCoefficient][l] = 1;
+            newTargets[feedforwardCoefficient][l] = newTargets[feedbackCoefficient][l] = newTargets[bleedCoefficient][l] = 0;
+        }
+
+        for (int i = 0; i < std::min (params.numStages, maxCombStages); ++i)
+        {
+            const int l = stageLanes[i];
+
+            if (l < 0)
+                continue;
+
+            const auto& stage = params.stages[i];
+            newTargets[delayCoefficient][l] = (SampleType) std::min (std::max ((float) (stage.delay*sampleRate), 1.0f), maxDelaySamples);
+            newTargets[feedforwardCoefficient][l] = (SampleType) stage.feedforward;
+            newTargets[feedbackCoefficient][l] = (SampleType) stage.feedback;
+            newTargets[bleedCoefficient][l] = (SampleType) stage.bleed;
+        }
+
+        const SampleType newMix = (SampleType) std::min (std::max (params.mix, 0.0f), 1.0f);
+        bool changed = newMix != mixTarget;
+
+        for (int c = 0; c < numCoefficients; ++c)
+            for (int l = 0; l < lanesPerChannel; ++l)
+                changed = changed || newTargets[c][l] != target[c][(size_t) l];
+
+        if (! (changed || snapRamps))
+            return;
+
+        for (int c = 0; c < numCoefficients; ++c)
+            std::copy (newTargets[c], newTargets[c] + lanesPerChannel, target[c].begin());
+
+        mixTarget = newMix;
+
+        if (snapRamps)
+        {
+            for (int c = 0; c < numCoefficients; ++c)
+                current[c] = target[c];
+
+            mix = mixTarget;
+            countdown = 0;
+            snapRamps = false;
+        }
+        else
+        {
+            for (int c = 0; c < numCoefficients; ++c)
+                for (size_t l = 0; l < (size_t) lanesPerChannel; ++l)
+                    step[c][l] = (target[c][l] - current[c][l])/(SampleType) rampLength;
+
+            mixStep = (mixTarget - mix)/(SampleType) rampLength;
+            countdown = rampLength;
+        }
+
+        updateReadPositions();
+    }
+
+    /** Splits each lane's delay into the offset back to its older tap and the fraction. */
+    void updateReadPositions() noexcept
+    {
+        for (size_t l = 0; l < (size_t) lanesPerChannel; ++l)
+        {
+            const SampleType delay = current[delayCoefficient][l];
+            const int wholeDelay = (int) delay;
+
+            readOffsets[l] = wholeDelay + 1;
+            fractions[l] = delay - (SampleType) wholeDelay;
+        }
+    }
+
+    /** Moves every ramp on by one sample, landing exactly on the targets at the end. */
+    void advanceRamps() noexcept
+    {
+        if (--countdown == 0)
+        {
+            for (int c = 0; c < numCoefficients; ++c)
+                current[c] = target[c];
+
+            mix = mixTarget;
+        }
+        else
+        {
+            for (int c = 0; c < numCoefficients; ++c)
+                for (size_t l = 0; l < (size_t) lanesPerChannel; ++l)
+                    current[c][l] += step[c][l];
+
+            mix += mixStep;
+        }
+
+        updateReadPositions();
+    }
+
+    void processSamples (SampleType* const* channels, int numChannelsToProcess, int numSamples) noexcept
+    {
+        const int frameSize = numChannels*lanesPerChannel;
+        const SampleType* const frames = delayLine.getReadPointer (0);
+        delayLineClear = delayLineClear && numSamples == 0;
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            if (countdown > 0)
+                advanceRamps();
+
+            // where each lane's older tap is, relative to the channel's first lane.
+            // Its newer tap is one frame on, in the guard region at the end
+            for (int l = 0; l < lanesPerChannel; ++l)
+                tapOffsets[l] = delayLine.wrap (writeIndex - readOffsets[(size_t) l])*frameSize + l;
+
+            const SampleType* ff = current[feedforwardCoefficient].data();
+            const SampleType* fb = current[feedbackCoefficient].data();
+            const SampleType* bl = current[bleedCoefficient].data();
+            SampleType* const written = delayLine.getWritePointer (writeIndex);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                const SampleType x = channel < numChannelsToProcess ? channels[channel][sample] : SampleType();
+                const int base = channel*lanesPerChannel;
+                const SampleType* const older = frames + base;
+                const SampleType* const newer = older + frameSize;
+                SampleType input = x;
+
+                for (int s = 0; s < numSections; ++s)
+                {
+                    const auto& section = sections[s];
+                    const auto in = Vector::broadcast (input);
+                    auto sum = Vector::broadcast (0);
+
+                    for (int v = 0; v < section.numVectors; ++v)
+                    {
+                        const int lane = section.firstLane + v*Vector::size;
+                        const auto newerTap = Vector::gather (newer, tapOffsets + lane);
+                        const auto delayed = newerTap + Vector::load (fractions.data() + lane)*(Vector::gather (older, tapOffsets + lane) - newerTap);
+                        const auto xh = in + Vector::load (fb + lane)*delayed;
+
+                        xh.store (written + base + lane);
+                        sum = sum + Vector::load (bl + lane)*xh + Vector::load (ff + lane)*delayed;
+                    }
+
+                    input = sum.getSum()/(SampleType) section.numStages;
+                }
+
+                if (channel < numChannelsToProcess)
+                    channels[channel][sample] = x + mix*(input - x);
+            }
+
+            // the first few frames are mirrored after the end, for the newer taps
+            if (writeIndex < DelayLine<SampleType>::guardSize)
+                std::copy (written, written + frameSize, delayLine.getMirrorPointer (writeIndex));
+
+            writeIndex = delayLine.wrap (writeIndex + 1);
+        }
+    }
+
+    //==============================================================================
+    CombBankParameters params;
+    double sampleRate = 44100.0;
+    int numChannels = 1, lanesPerChannel = Vector::size;
+    float maxDelaySamples = 1.0f;
+
+    DelayLine<SampleType> delayLine;
+    int writeIndex = 0;
+    int tapOffsets[maxLanesPerChannel] = {};
+
+    Section sections[maxCombStages];
+    int numSections = 0;
+    int stageLanes[maxCombStages] = {};
+
+    std::vector<SampleType> current[numCoefficients], target[numCoefficients], step[numCoefficients];
+    std::vector<int> readOffsets;
+    std::vector<SampleType> fractions;
+    SampleType mix = 1, mixTarget = 1, mixStep = 0;
+    int rampLength = 1, countdown = 0;
+    bool snapRamps = true, delayLineClear = true;
+};
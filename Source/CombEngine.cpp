@@ -0,0 +1,16 @@
+/*
+  ==============================================================================
+
+    CombEngine.cpp
+
+    The one place the float and double engines are compiled, for builds that
+    define COMB_EXTERN_TEMPLATES (the CMake build's comb_kernel library). The
+    Projucer builds include CombEngine.h directly and don't need this file.
+
+  ==============================================================================
+*/
+
+#include "CombEngine.h"
+
+template class CombEngine<float>;
+template class CombEngine<double>;
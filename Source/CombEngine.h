@@ -0,0 +1,2069 @@
+/*
+  ==============================================================================
+
+    CombEngine.h
+
+    The universal comb filter kernel, kept free of any JUCE/plugin plumbing so
+    that it can be driven from the processor, the benchmark and offline tools.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "CombLfo.h"
+#include "DelayLine.h"
+#include "FloatVector.h"
+#include "Interpolators.h"
+#include "Oversampler.h"
+
+//==============================================================================
+/** Most modulated taps (voices) that can read one delay line. */
+static constexpr int maxCombVoices = 8;
+
+/**
+    Parameter values used by the engine for one block. Times are in seconds.
+*/
+struct CombParameters
+{
+    float delay       = 0.0f;     // minimum delay
+    float sweepWidth  = 0.002f;   // LFO modulation depth
+    float lfoFreq     = 0.5f;     // Hz
+    float bleed       = 0.7f;
+    float feedforward = 0.7f;
+    float feedback    = 0.7f;
+    bool tremolo      = false;
+    InterpolationQuality interpolation = InterpolationQuality::linear;
+    OversamplingMode oversampling = OversamplingMode::off;
+    float maxDelay    = 0.55f;    // longest delay the delay line has room for
+
+    int voices        = 1;        // modulated taps reading the delay line, 1 to maxCombVoices
+    float voicePhase[maxCombVoices] = {};                                           // each voice's LFO phase offset, in cycles
+    float voiceDepth[maxCombVoices] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };  // each voice's share of sweepWidth
+
+    /** Sets up numVoices voices at full depth, with their LFO phases spread evenly
+        over spread cycles (1 spaces them all the way round).
+    */
+    void spreadVoices (int numVoices, float spread) noexcept
+    {
+        voices = std::min (std::max (numVoices, 1), maxCombVoices);
+
+        for (int v = 0; v < maxCombVoices; ++v)
+        {
+            voicePhase[v] = spread*(float) v/(float) voices;
+            voiceDepth[v] = 1.0f;
+        }
+    }
+
+    /** The widest sweep of any voice. */
+    float getMaxSweepWidth() const noexcept
+    {
+        float depth = 0.0f;
+
+        for (int v = 0; v < std::min (std::max (voices, 1), maxCombVoices); ++v)
+            depth = std::max (depth, voiceDepth[v]);
+
+        return sweepWidth*depth;
+    }
+};
+
+/**
+    Parameter values reached at a sample offset within a block, for sample
+    accurate automation (see CombEngine::process()).
+*/
+struct CombParameterChange
+{
+    int sampleOffset = 0;
+    CombParameters params;
+};
+
+//==============================================================================
+/**
+    A value that moves linearly to a new target over a fixed time, in the manner
+    of juce::LinearSmoothedValue, but rendered a whole block at a time so the
+    kernel can read it from a plain array.
+*/
+class ParameterRamp
+{
+public:
+    void prepare (double sampleRate, double rampSeconds, int maxBlockSize)
+    {
+        setRampTime (sampleRate, rampSeconds);
+        values.assign ((size_t) std::max (1, maxBlockSize), target);
+        setCurrentAndTarget (target);
+    }
+
+    /** Changes the ramp length without reallocating. Takes effect from the next setTarget(). */
+    void setRampTime (double sampleRate, double rampSeconds) noexcept
+    {
+        rampLength = std::max (1, (int)(rampSeconds*sampleRate));
+    }
+
+    void setCurrentAndTarget (float newValue) noexcept
+    {
+        current = target = newValue;
+        countdown = 0;
+        numSettled = 0;
+    }
+
+    void setTarget (float newTarget) noexcept
+    {
+        if (newTarget == target)
+            return;
+
+        target = newTarget;
+        countdown = rampLength;
+        step = (target - current)/(float)countdown;
+    }
+
+    /** Moves from the current value to newTarget over exactly numSteps values,
+        whatever the ramp time. A ramp already heading for newTarget carries on
+        as it was, so a change repeated every block still settles.
+    */
+    void setTarget (float newTarget, int numSteps) noexcept
+    {
+        if (newTarget == target)
+            return;
+
+        target = newTarget;
+        countdown = current == target ? 0 : std::max (1, numSteps);
+        step = countdown > 0 ? (target - current)/(float)countdown : 0.0f;
+    }
+
+    /** Carries the ramp over to a rate ratio times the old one: it goes on from
+        newCurrent to newTarget, the same values in the new units, and gets
+        there after as long as it would have taken at the old rate.
+    */
+    void changeRate (double ratio, float newCurrent, float newTarget) noexcept
+    {
+        target = newTarget;
+        countdown = countdown > 0 ? std::max (1, (int) std::lround (countdown*ratio)) : 0;
+        current = countdown > 0 ? newCurrent : newTarget;
+        step = countdown > 0 ? (target - current)/(float) countdown : 0.0f;
+        numSettled = 0;
+    }
+
+    bool isSmoothing() const noexcept   { return countdown > 0; }
+
+    /** True if the last numSamples values rendered were all equal to the target. */
+    bool wasSettledFor (int numSamples) const noexcept  { return countdown == 0 && numSettled >= numSamples; }
+    float getTarget() const noexcept    { return target; }
+    float getCurrentValue() const noexcept  { return current; }
+
+    /** Renders the next numSamples values (at most the prepared block size) and
+        advances the ramp. Once the target has been reached the buffer is only
+        refilled when it changes.
+    */
+    const float* render (int numSamples) noexcept
+    {
+        if (countdown == 0 && numSettled >= numSamples)
+            return values.data();
+
+        float* dest = values.data();
+        const int numRamped = std::min (numSamples, countdown);
+
+        for (int i = 0; i < numRamped; ++i)
+        {
+            current += step;
+            dest[i] = current;
+        }
+
+        countdown -= numRamped;
+        numSettled = 0;
+
+        if (countdown == 0)
+        {
+            current = target;
+            std::fill (dest + numRamped, dest + numSamples, target);
+            numSettled = numRamped == 0 ? numSamples : 0;
+        }
+
+        return dest;
+    }
+
+private:
+    std::vector<float> values;
+    float current = 0.0f, target = 0.0f, step = 0.0f;
+    int countdown = 0, rampLength = 1, numSettled = 0;
+};
+
+//==============================================================================
+/**
+    Universal comb filter with an LFO-modulated, interpolated delay:
+
+        xh[n] = x[n] + fb*xh[n-M[n]]
+        y[n]  = bl*xh[n] + ff*xh[n-M[n]]
+
+    where M[n] = delay + sweepWidth*lfo[n]. Processing is done in place.
+
+    With more than one voice, xh[n-M[n]] is instead the average of that many
+    taps, M_v[n] = delay + depth_v*sweepWidth*lfo[n + phase_v], all read from the
+    one delay line, so an ensemble costs one write and a few reads rather than
+    a filter per voice. Fading a voice in or out, and changing its phase or
+    depth, ramps like the other parameters.
+
+    Everything that is common to all channels (parameter ramps, the LFO, and the
+    read index and interpolation fraction of M[n]) is rendered once per block
+    into scratch buffers. The channels themselves share a single interleaved
+    delay line and are processed as lanes of a SimdVector, so each sample step
+    costs one vector operation per four channels. Because every lane moves
+    through the line together, one write index serves all of them, and each
+    channel still only ever reads back its own history.
+
+    Each block takes one of three paths:
+     - feedforward only, when fb is 0 for the whole block: the input is written
+       to the delay line in one go and every output sample is independent;
+     - long delay, when every tap read in the block was written before it: all
+       taps are read first, then the mix and the delay line write are done as
+       straight passes over the block;
+     - otherwise the recursive kernel, which steps through the block a frame at
+       a time because taps may depend on samples from the same block.
+
+    Every path is instantiated for each interpolator in Interpolators.h, and the
+    interpolation quality is picked once per block.
+
+    The voices' read positions are worked out for all of them at once, from
+    arrays of maxCombVoices coefficients that the compiler runs as SIMD lanes;
+    the taps themselves are then read and summed voice by voice, each across the
+    channel lanes as usual. One voice at the plain LFO phase, or any number
+    when nothing is modulated, takes the single-tap paths.
+
+    Parameters either ramp to new values over rampSeconds from the start of a
+    process() call, or, given as CombParameterChanges, reach them at exact
+    sample offsets. In that case the block is split into segments between the
+    changes, so automation doesn't depend on the buffer size.
+
+    SampleType (float or double) is the type of the audio path: the frames, the
+    delay line, and interpolator and filter state. The control path (ramps and
+    LFO values) is float for both, since its precision only has to cover a
+    fraction of a sample of delay. Read positions are summed in fixed point,
+    though (see ReadPositionFormat): a float holding a delay of 100000 samples
+    only resolves 1/128 of a sample, while the fixed-point position resolves the
+    same fraction all the way along the delay line.
+
+    Fast, deep modulation (audio-rate LFOs, ring modulation) pitch-shifts the
+    delayed signal far enough to alias. The kernel can instead run at 2x or 4x
+    the sample rate between a pair of polyphase half-band filters (see
+    Oversampler.h), which costs the factor times the kernel plus the filters:
+    about 2.6x the 1x cost at 2x and 4.8x at 4x for stereo ring mod with
+    linear interpolation (CombBenchmark). It adds getLatencySamples() of
+    latency. In automatic mode it is only used while the modulation is fast
+    enough to need it, and never goes beyond 4x, or beyond maxKernelRate at
+    high sample rates. Automatic mode changes factor at the start of a
+    process() call or automation segment: the history in the delay line is
+    resampled to the new rate, and the first switchCrossfadeSeconds are
+    rendered at both factors and crossfaded, which covers the new filters
+    settling. Other modes change factor by starting the delay line again from
+    silence, as does automatic mode on the first block after prepare() or
+    reset(), or while the engine idles (see process()).
+
+    The delay line is sized for CombParameters::maxDelay. prepare() keeps the
+    existing allocation unless it has to grow. If maxDelay is raised while
+    processing, the larger line is allocated by growDelayLine(), which must be
+    called from a thread other than the audio thread whenever needsGrowing()
+    says so, or ahead of time by reserveDelay(). The following process() calls
+    carry the history so far over to it, historyCopySamples at a time, then
+    swap it in, and the old storage goes back to growDelayLine() to be freed.
+    Until then, delays are limited to what the current line can hold.
+
+    With COMB_EXTERN_TEMPLATES, the float and double engines are only
+    instantiated in CombEngine.cpp, so every program linking it runs the same
+    compiled (and profiled) kernel.
+*/
+template <typename SampleType>
+class CombEngine
+{
+public:
+    using Vector = SimdVector<SampleType>;
+
+    /** Highest rate the kernel is oversampled to. Beyond this, sample rates are
+        already high enough for modulation not to alias into the audible range,
+        and the delay line would only take up more memory.
+    */
+    static constexpr double maxKernelRate = 192000.0;
+
+    /** Widest bus the kernels are specialised for: 7.1.4 or 3rd order ambisonics.
+        More channels still work, through a slower generic kernel.
+    */
+    static constexpr int maxChannels = 16;
+
+    /** The read head always trails the write head by at least this many samples. */
+    static constexpr int minDelaySamples = 3;
+
+    /** Time taken for the delay, depth and gain parameters to reach a new value. */
+    static constexpr double rampSeconds = 0.02;
+
+    /** Shortest ramp to a timed parameter change, so that sparse or sudden
+        changes still don't click.
+    */
+    static constexpr double minAutomationRampSeconds = 0.005;
+
+    /** Peak rate of change of the delay, in samples per sample, above which
+        automatic oversampling switches to 2x and to 4x. Switching back down waits
+        until the rate has dropped below autoHysteresis times the threshold.
+    */
+    static constexpr double autoThreshold2x = 0.25, autoThreshold4x = 1.0, autoHysteresis = 0.7;
+
+    /** Length of the crossfade when automatic oversampling changes factor mid-play,
+        or of the segment it happens in if that is shorter.
+    */
+    static constexpr double switchCrossfadeSeconds = 0.005;
+
+    /** Level (about -100 dBFS) below which input and delay line contents count as
+        silence, for the tail length and idling.
+    */
+    static constexpr double silenceThreshold = 1.0e-5;
+
+    /** Samples of history carried over to a grown delay line per block, on top
+        of what the block itself writes: 256 kB at float.
+    */
+    static constexpr int historyCopySamples = 1 << 16;
+
+    /** How long the filter keeps producing output after its input stops, for the
+        given parameters at a sample rate: until feedback has brought the longest
+        loop down to silenceThreshold. Infinite if the feedback gain is 1. The
+        loop is never shorter than minDelaySamples, and a sample more for the
+        interpolators, however small the delay. Doesn't include the latency.
+    */
+    static double getTailLengthSeconds (const CombParameters& p, double sampleRate) noexcept
+    {
+        const double longestDelay = (double) p.delay + (double) p.getMaxSweepWidth() + (minDelaySamples + 1)/sampleRate;
+
+        if (p.feedback <= 0.0f)
+            return longestDelay;
+
+        if (p.feedback >= 1.0f)
+            return std::numeric_limits<double>::infinity();
+
+        return longestDelay*(1.0 + std::ceil (std::log (silenceThreshold)/std::log ((double) p.feedback)));
+    }
+
+    //==============================================================================
+    void prepare (double newSampleRate, int newNumChannels, int maxBlockSize)
+    {
+        hostSampleRate = newSampleRate;
+        lfo.prepare (hostSampleRate);
+
+        numChannels = std::max (1, newNumChannels);
+        numLanes = (numChannels + Vector::size - 1)/Vector::size*Vector::size;
+
+        maxFactor = Oversampler<SampleType>::maxFactor;
+        while (maxFactor > 1 && hostSampleRate*maxFactor > maxKernelRate)
+            maxFactor /= 2;
+
+        {
+            // anything grown for the previous configuration is no use now
+            const std::lock_guard<std::mutex> lock (growthLock);
+            grownDelayLine.freeStorage();
+            requiredCapacity = 0;
+            growthState = noGrowth;
+            historyCopied = -1;
+        }
+
+        // everything that runs at the kernel rate is sized for the highest
+        // oversampling factor, so switching factor never allocates
+        delayLine.setSize (numLanes, getRequiredCapacity());
+
+        // shared with every other engine in the process
+        if (tables == nullptr)
+            tables = InterpolationTables::getShared();
+
+        blockLength = std::max (1, maxBlockSize);
+        for (auto& ramp : ramps)
+            ramp.prepare (hostSampleRate, rampSeconds, blockLength*maxFactor);
+
+        lfoValues.assign ((size_t) (blockLength*maxFactor), 0.0f);
+        quadratureValues.assign ((size_t) (blockLength*maxFactor), 0.0f);
+        readOffsets.assign ((size_t) (blockLength*maxFactor), 0);
+        fractions.assign ((size_t) (blockLength*maxFactor), 0.0f);
+        outputGains.assign ((size_t) (blockLength*maxFactor), 0.0f);
+        voiceReadOffsets.assign ((size_t) (blockLength*maxFactor*maxCombVoices), 0);
+        voiceFractions.assign ((size_t) (blockLength*maxFactor*maxCombVoices), 0.0f);
+        voiceGains.assign ((size_t) (blockLength*maxFactor*maxCombVoices), 0.0f);
+        frames.assign ((size_t) (blockLength*maxFactor*numLanes), SampleType());
+        delayed.assign ((size_t) (blockLength*maxFactor*numLanes), SampleType());
+        baseFrames.assign ((size_t) (blockLength*numLanes), SampleType());
+        latencyFrames.assign ((size_t) (latencyRingSize*numLanes), SampleType());
+        interpolatorState.assign ((size_t) (numLanes*maxCombVoices), SampleType());
+        oversampler.prepare (numLanes);
+
+        for (int mode = 0; mode < numOversamplingModes; ++mode)
+            modeLatencySamples[mode].store (computeLatencySamples ((OversamplingMode) mode), std::memory_order_relaxed);
+
+        // automatic mode keeps the state a switch has to put back, and a spare
+        // set of filters to switch to
+        spareOversampler.prepare (numLanes);
+        inputHistory.assign ((size_t) (historySize*numLanes), SampleType());
+        outputHistory.assign ((size_t) (historySize*numLanes), SampleType());
+        historyScratch.assign ((size_t) ((historyScratchFrames + historyAheadFrames)*numLanes), SampleType());
+        switchInput.assign ((size_t) (blockLength*numChannels), SampleType());
+        switchOutput.assign ((size_t) (blockLength*numChannels), SampleType());
+        savedState.delayFrames.assign ((size_t) (blockLength*maxFactor*numLanes), SampleType());
+        savedState.interpolatorState = interpolatorState;
+        savedState.latencyFrames = latencyFrames;
+
+        for (int i = 0; i < numRamps; ++i)
+            savedState.ramps[i] = ramps[i];
+
+        oversamplingFactor = 0;
+        setOversamplingFactor (chooseOversamplingFactor());
+        reset();
+    }
+
+    void reset()
+    {
+        clearSignalState();
+        lfo.reset();
+    }
+
+    /** Sets the parameter targets for the following process() calls. Continuous
+        parameters ramp to their new values rather than jumping, except on the
+        first block after prepare() or reset().
+    */
+    void setParameters (const CombParameters& newParams) noexcept { params = newParams; }
+    const CombParameters& getParameters() const noexcept          { return params; }
+
+    /** Renders the LFO at control rate (see CombLfo) instead of every sample. */
+    void setLfoControlRate (bool shouldUseControlRate) noexcept   { lfo.setControlRate (shouldUseControlRate); }
+
+    int getNumChannels() const noexcept        { return numChannels; }
+    int getDelayCapacity() const noexcept      { return delayLine.getCapacity(); }
+
+    /** True if growDelayLine() has work to do: a larger delay line to allocate,
+        or an old one to free. Can be called from any thread.
+    */
+    bool needsGrowing() const noexcept
+    {
+        const int state = growthState.load (std::memory_order_acquire);
+        return state == retired || (state == noGrowth && requiredCapacity.load (std::memory_order_relaxed) > 0);
+    }
+
+    /** Allocates the larger delay line asked for by the current maxDelay and
+        frees any that have been replaced. Must not be called from the audio
+        thread; process() never waits for it.
+    */
+    void growDelayLine()
+    {
+        const std::lock_guard<std::mutex> lock (growthLock);
+
+        if (growthState.load (std::memory_order_acquire) == retired)
+        {
+            grownDelayLine.freeStorage();
+            growthState.store (noGrowth, std::memory_order_release);
+        }
+
+        const int capacity = requiredCapacity.load (std::memory_order_relaxed);
+
+        if (capacity > 0 && growthState.load (std::memory_order_relaxed) == noGrowth)
+        {
+            grownDelayLine.setSize (numLanes, capacity);
+            growthState.store (grown, std::memory_order_release);
+        }
+    }
+
+    /** Allocates a delay line long enough for maxDelaySeconds straight away if the
+        current one is shorter, rather than waiting for process() to ask, for when
+        a larger maximum is known to be coming (a state being restored, say) and
+        nothing may be calling growDelayLine(). The following process() calls
+        carry the history over to it as usual. Must not be called from the audio
+        thread, and only after prepare().
+    */
+    void reserveDelay (double maxDelaySeconds)
+    {
+        const std::lock_guard<std::mutex> lock (growthLock);
+
+        if (growthState.load (std::memory_order_acquire) == retired)
+        {
+            grownDelayLine.freeStorage();
+            growthState.store (noGrowth, std::memory_order_release);
+        }
+
+        // the audio thread only swaps lines in the grown state, so the capacity
+        // is settled in this one
+        const int capacity = getRequiredCapacity (maxDelaySeconds);
+
+        if (growthState.load (std::memory_order_relaxed) == noGrowth && capacity > delayLine.getCapacity())
+        {
+            grownDelayLine.setSize (numLanes, capacity);
+            growthState.store (grown, std::memory_order_release);
+        }
+    }
+
+    /** True from when growDelayLine() has allocated a larger delay line until
+        process() has carried the history over to it and swapped it in.
+    */
+    bool isGrowingDelayLine() const noexcept   { return growthState.load (std::memory_order_acquire) == grown; }
+
+    /** The factor the kernel is currently running at: 1, 2 or 4. */
+    int getOversamplingFactor() const noexcept { return oversamplingFactor; }
+
+    /** Latency of the output in a given oversampling mode, in whole samples: the
+        filters' delay at the mode's factor. In automatic mode it is the delay at
+        the highest factor, and the output is held back by the difference at
+        lower ones, so the latency stays the same whichever factor is in use. It
+        only changes with the mode or in prepare(), which works it out for every
+        mode, so it can be asked for from any thread without going near the
+        filters the audio thread is using.
+    */
+    int getLatencySamples (OversamplingMode mode) const noexcept
+    {
+        const int index = (int) mode;
+        return index >= 0 && index < numOversamplingModes ? modeLatencySamples[index].load (std::memory_order_relaxed) : 0;
+    }
+
+    /** Latency in the oversampling mode of the current parameters. */
+    int getLatencySamples() const noexcept     { return getLatencySamples (params.oversampling); }
+
+    /** True while any parameter, or any voice, is still ramping to its target. */
+    bool isSmoothing() const noexcept
+    {
+        for (auto& ramp : ramps)
+            if (ramp.isSmoothing())
+                return true;
+
+        for (int v = 0; v < maxCombVoices; ++v)
+            if (isVoiceRamping (v))
+                return true;
+
+        return false;
+    }
+
+    /** True while the engine is idling on silence (see process()). */
+    bool isIdle() const noexcept               { return idle; }
+
+    /** The LFO's value (0 to 1) where the last process() call left it. For display. */
+    float getLfoValue() const noexcept
+    {
+        return (float) (0.5 + 0.5*std::sin (6.283185307179586*lfo.getPhase()));
+    }
+
+    /** The delay M[n] the read head was at when the last process() call ended,
+        in seconds, including the minimum gap behind the write head. For display.
+    */
+    double getCurrentDelaySeconds() const noexcept
+    {
+        const float currentDelay = ramps[delayRamp].getCurrentValue() + ramps[widthRamp].getCurrentValue()*getLfoValue();
+        return (double) (std::min (std::max (currentDelay, 0.0f), maxDelaySamples) + (float) minDelaySamples)/sampleRate;
+    }
+
+    //==============================================================================
+    /** Filters numChannels channels of numSamples samples in place. Channels
+        beyond those given to prepare() are left untouched.
+
+        The peak of everything written to the delay line is tracked. Once it has
+        stayed below silenceThreshold for longer than the longest possible delay,
+        nothing that can still be read back is audible. From then on, any block
+        whose input is also below silenceThreshold is replaced with silence
+        without running the kernel, and the delay line is cleared. The first
+        block with input above the threshold wakes it up again.
+    */
+    void process (SampleType* const* channels, int numChannelsToProcess, int numSamples) noexcept
+    {
+        processSegment (channels, numChannelsToProcess, 0, numSamples, -1);
+    }
+
+    /** Processes a block with sample-accurate automation. Each change gives the
+        parameter values reached at its sampleOffset, and the continuous ones
+        move to them in a straight line from where they were at the previous
+        change (or the start of the block), which is how hosts describe
+        automation curves. Ramps are never shorter than minAutomationRampSeconds
+        though, so a change at offset 0 is reached slightly late, and a change
+        to the value a parameter is already ramping to doesn't start the ramp
+        again, so it still arrives however short the blocks are. Discrete
+        parameters switch at the start of the segment leading up to their change.
+
+        The block is split at each change, so changes should be sorted by offset.
+        After the last one, the parameters stay as they are.
+    */
+    void process (SampleType* const* channels, int numChannelsToProcess, int numSamples,
+                  const CombParameterChange* changes, int numChanges) noexcept
+    {
+        const int minRampSamples = (int) (minAutomationRampSeconds*hostSampleRate);
+        int position = 0;
+
+        for (int i = 0; i < numChanges; ++i)
+        {
+            const int end = std::min (std::max (changes[i].sampleOffset, position), numSamples);
+
+            params = changes[i].params;
+            processSegment (channels, numChannelsToProcess, position, end - position, std::max (end - position, minRampSamples));
+            position = end;
+        }
+
+        if (position < numSamples)
+            processSegment (channels, numChannelsToProcess, position, numSamples - position, -1);
+    }
+
+private:
+    /** Frames the delay line needs for the current maxDelay at the highest factor. */
+    int getRequiredCapacity() const noexcept    { return getRequiredCapacity ((double) params.maxDelay); }
+
+    int getRequiredCapacity (double maxDelaySeconds) const noexcept
+    {
+        return (int) (std::max (0.0, maxDelaySeconds)*hostSampleRate*maxFactor) + minDelaySamples + maxInterpolatorTaps + 2;
+    }
+
+    /** Asks for a larger delay line if the current one is too short for maxDelay. */
+    void updateDelayLineSize() noexcept
+    {
+        const int required = getRequiredCapacity();
+        requiredCapacity.store (required > delayLine.getCapacity() ? required : 0, std::memory_order_relaxed);
+        updateMaxDelaySamples();
+    }
+
+    /** Carries the history over to a grown delay line a piece at a time, so that
+        no one block pays for copying all of it, and swaps the grown line in once
+        the copy has caught up. The old line goes on being written meanwhile.
+        Frame i of the grown line is the one written oldCapacity frames before
+        historyStart, and each step copies at least as many frames, oldest
+        first, as the chunk after it writes, so nothing is overwritten before
+        it has been copied.
+    */
+    void copyHistoryStep() noexcept
+    {
+        // the copy waits for a factor switch's stale frames to be cleared first
+        if (growthState.load (std::memory_order_acquire) != grown || numFreshFrames < staleHistoryEnd)
+            return;
+
+        if (historyCopied < 0)
+        {
+            historyStart = delayWrite;
+            historyCopied = 0;
+            historyWritten = 0;
+        }
+        else
+        {
+            historyWritten += delayLine.wrap (delayWrite - lastDelayWrite);
+        }
+
+        lastDelayWrite = delayWrite;
+
+        const int numToCopy = delayLine.getCapacity() + historyWritten;
+        const int numFrames = std::min (historyCopySamples/numLanes + blockLength*maxFactor, numToCopy - historyCopied);
+
+        grownDelayLine.copyFramesFrom (delayLine, delayLine.wrap (historyStart + historyCopied),
+                                       grownDelayLine.wrap (historyCopied), numFrames);
+        historyCopied += numFrames;
+
+        if (historyCopied == numToCopy)
+        {
+            delayWrite = grownDelayLine.wrap (numToCopy);
+            delayLine.swapWith (grownDelayLine);
+            historyCopied = -1;
+            updateDelayLineSize();
+
+            // the old line now belongs to growDelayLine(), to be freed
+            growthState.store (retired, std::memory_order_release);
+        }
+    }
+
+    /** Limits delays to maxDelay, or to what fits in the delay line if that is shorter. */
+    void updateMaxDelaySamples() noexcept
+    {
+        const double longestDelay = (double) (delayLine.getCapacity() - minDelaySamples - maxInterpolatorTaps - 2);
+        maxDelaySamples = (float) std::max (0.0, std::min (std::max (0.0, (double) params.maxDelay)*sampleRate, longestDelay));
+
+        // the delay and the modulation, each up to the maximum, have to fit in
+        // 31 bits together. Up to 24 bits of fraction are exact in a float
+        auto& format = readPositionFormat;
+        format.fractionBits = 24;
+
+        while (format.fractionBits > 0 && std::ldexp (2.0*((double) maxDelaySamples + 1.0), format.fractionBits) >= 2147483648.0)
+            --format.fractionBits;
+
+        format.scale = std::ldexp (1.0f, format.fractionBits);
+        format.inverseScale = 1.0f/format.scale;
+        format.maxDelay = maxDelaySamples;
+        format.maxPosition = (int) (maxDelaySamples*format.scale);
+    }
+
+    /** Counts as silent once everything readable from the delay line was written
+        below silenceThreshold, which covers the longest possible delay.
+    */
+    bool hasDecayed() const noexcept
+    {
+        return numSilentFrames > (int) maxDelaySamples + minDelaySamples + maxInterpolatorTaps;
+    }
+
+    bool isInputSilent (const SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples) const noexcept
+    {
+        const int numVectorSamples = numSamples/Vector::size*Vector::size;
+        auto peaks = Vector::broadcast (0);
+        SampleType peak = 0;
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            const SampleType* src = channels[channel] + offset;
+
+            for (int sample = 0; sample < numVectorSamples; sample += Vector::size)
+                peaks = Vector::max (peaks, Vector::load (src + sample).abs());
+
+            for (int sample = numVectorSamples; sample < numSamples; ++sample)
+                peak = std::max (peak, std::abs (src[sample]));
+        }
+
+        return std::max (peak, peaks.getMax()) < (SampleType) silenceThreshold;
+    }
+
+    /** Updates numSilentFrames from the peak of the numFrames frames just written to the delay line. */
+    void trackWrittenPeak (int numFrames) noexcept
+    {
+        auto peaks = Vector::broadcast (0);
+        int index = delayLine.wrap (delayWrite - numFrames);
+
+        for (int done = 0; done < numFrames;)
+        {
+            const int numInRun = std::min (numFrames - done, delayLine.getCapacity() - index);
+            const SampleType* src = delayLine.getReadPointer (index);
+
+            for (int i = 0; i < numInRun*numLanes; i += Vector::size)
+                peaks = Vector::max (peaks, Vector::load (src + i).abs());
+
+            done += numInRun;
+            index = 0;
+        }
+
+        if (peaks.getMax() < (SampleType) silenceThreshold)
+            numSilentFrames = std::min (numSilentFrames + numFrames, std::numeric_limits<int>::max()/2);
+        else
+            numSilentFrames = 0;
+    }
+
+    enum RampIndex { delayRamp, widthRamp, bleedRamp, feedforwardRamp, feedbackRamp, tremoloRamp, numRamps };
+
+    /** The oversampling filters' round trip delay at a factor, rounded to whole samples. */
+    int getFilterLatencySamples (int factor) const noexcept     { return (int) std::lround (oversampler.getLatency (factor)); }
+
+    int computeLatencySamples (OversamplingMode mode) const noexcept
+    {
+        switch (mode)
+        {
+            case OversamplingMode::x2:          return getFilterLatencySamples (std::min (2, maxFactor));
+            case OversamplingMode::x4:          return getFilterLatencySamples (std::min (4, maxFactor));
+            case OversamplingMode::automatic:   return getFilterLatencySamples (maxFactor);
+            case OversamplingMode::off:
+            default:                            return 0;
+        }
+    }
+
+    /** Holds numSamples interleaved output frames back by latencyPad frames. */
+    void padLatency (SampleType* data, int numSamples) noexcept
+    {
+        if (latencyPad == 0)
+            return;
+
+        constexpr int mask = latencyRingSize - 1;
+
+        for (int frame = 0; frame < numSamples; ++frame)
+        {
+            SampleType* io = data + frame*numLanes;
+            const SampleType* held = latencyFrames.data() + ((latencyWrite - latencyPad) & mask)*numLanes;
+
+            std::copy (io, io + numLanes, latencyFrames.data() + latencyWrite*numLanes);
+            std::copy (held, held + numLanes, io);
+            latencyWrite = (latencyWrite + 1) & mask;
+        }
+    }
+
+    /** Picks the factor for the current parameters, with hysteresis in automatic mode. */
+    int chooseOversamplingFactor() const noexcept
+    {
+        switch (params.oversampling)
+        {
+            case OversamplingMode::x2:          return std::min (2, maxFactor);
+            case OversamplingMode::x4:          return std::min (4, maxFactor);
+            case OversamplingMode::automatic:   break;
+            case OversamplingMode::off:
+            default:                            return 1;
+        }
+
+        // M[n] = delay + sweepWidth*(0.5 + 0.5*sin(2*pi*f*t)) changes by at most
+        // pi*sweepWidth*f samples per sample, whatever the sample rate
+        const double rate = 3.141592653589793*params.getMaxSweepWidth()*params.lfoFreq;
+        const double current = (double) oversamplingFactor;
+
+        if (rate > autoThreshold4x*(current >= 4 ? autoHysteresis : 1.0))
+            return std::min (4, maxFactor);
+
+        if (rate > autoThreshold2x*(current >= 2 ? autoHysteresis : 1.0))
+            return std::min (2, maxFactor);
+
+        return 1;
+    }
+
+    void clearSignalState() noexcept
+    {
+        delayLine.clear();
+        std::fill (interpolatorState.begin(), interpolatorState.end(), SampleType());
+        std::fill (latencyFrames.begin(), latencyFrames.end(), SampleType());
+        std::fill (inputHistory.begin(), inputHistory.end(), SampleType());
+        std::fill (outputHistory.begin(), outputHistory.end(), SampleType());
+        oversampler.reset();
+        delayWrite = 0;
+        snapRamps = true;
+        staleHistoryEnd = 0;
+        abandonHistoryCopy();
+
+        // an empty delay line has nothing left to decay
+        numSilentFrames = std::numeric_limits<int>::max()/2;
+    }
+
+    /** Gives up on carrying the history over to a grown delay line, once the
+        history has changed in some way other than being written to. The grown
+        line goes back to growDelayLine() to be replaced with an empty one.
+    */
+    void abandonHistoryCopy() noexcept
+    {
+        if (historyCopied >= 0)
+        {
+            historyCopied = -1;
+            growthState.store (retired, std::memory_order_release);
+        }
+    }
+
+    /** Moves everything that runs at the kernel rate to a new factor. Doesn't allocate. */
+    void setOversamplingFactor (int newFactor) noexcept
+    {
+        oversamplingFactor = newFactor;
+        sampleRate = hostSampleRate*newFactor;
+        updateMaxDelaySamples();
+        lfo.setSampleRate (sampleRate);
+
+        for (auto& ramp : ramps)
+            ramp.setRampTime (sampleRate, rampSeconds);
+    }
+
+    /** Processes numSamples from offset with the current params. The continuous
+        parameters ramp to them over rampSamples (at the host rate), or over
+        rampSeconds if that is negative.
+    */
+    void processSegment (SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples, int rampSamples) noexcept
+    {
+        const int newFactor = chooseOversamplingFactor();
+        numChannelsToProcess = std::min (numChannelsToProcess, numChannels);
+        int done = 0;
+
+        if (newFactor != oversamplingFactor)
+        {
+            // automatic mode crossfades to the new factor while there's something
+            // playing to interrupt. Otherwise, and before anything has been
+            // written since the signal state was last cleared, the delay line
+            // starts again from silence, but the LFO carries on where it was
+            const int numCrossfaded = std::min (std::min (numSamples, blockLength), std::max (1, (int) (switchCrossfadeSeconds*hostSampleRate)));
+
+            if (params.oversampling == OversamplingMode::automatic && ! idle && ! snapRamps
+                 && ! (hasDecayed() && isInputSilent (channels, numChannelsToProcess, offset, numCrossfaded)))
+            {
+                crossfadeToFactor (newFactor, channels, numChannelsToProcess, offset, numCrossfaded, rampSamples);
+                done = numCrossfaded;
+            }
+            else
+            {
+                setOversamplingFactor (newFactor);
+                clearSignalState();
+            }
+        }
+
+        if (done == 0)
+        {
+            updateLatencyPad();
+            updateDelayLineSize();
+            updateRampTargets (rampSamples < 0 ? -1 : rampSamples*oversamplingFactor);
+        }
+
+        for (; done < numSamples; done += blockLength)
+        {
+            copyHistoryStep();
+            processChunk (channels, numChannelsToProcess, offset + done, std::min (blockLength, numSamples - done));
+        }
+    }
+
+    /** Holds the output back by whatever the mode's latency is beyond the
+        filters' at the current factor, so it comes out with the same latency
+        whatever the factor.
+    */
+    int getLatencyPad() const noexcept
+    {
+        return std::min (std::max (0, getLatencySamples() - getFilterLatencySamples (oversamplingFactor)), latencyRingSize - 1);
+    }
+
+    void updateLatencyPad() noexcept
+    {
+        const int newLatencyPad = getLatencyPad();
+
+        if (newLatencyPad != latencyPad)
+        {
+            std::fill (latencyFrames.begin(), latencyFrames.end(), SampleType());
+            latencyPad = newLatencyPad;
+        }
+    }
+
+    /** Everything processChunk() changes, other than scratch buffers and the
+        oversampler, for crossfadeToFactor() to put back.
+    */
+    struct SavedState
+    {
+        ParameterRamp ramps[numRamps];
+        CombLfo lfo;
+        InterpolationQuality interpolation = InterpolationQuality::linear;
+        int voiceRampPosition[maxCombVoices] = {};
+        int numActiveVoices = 1, delayWrite = 0, numSilentFrames = 0, latencyWrite = 0, historyWrite = 0, numDelayFrames = 0;
+        bool voiced = false;
+        std::vector<SampleType> interpolatorState, latencyFrames, delayFrames;
+    };
+
+    /** Saves the state, including the numFrames delay line frames the next chunk will overwrite. */
+    void saveState (int numFrames) noexcept
+    {
+        auto& s = savedState;
+
+        for (int i = 0; i < numRamps; ++i)
+            s.ramps[i] = ramps[i];
+
+        s.lfo = lfo;
+        s.interpolation = currentInterpolation;
+        std::copy (std::begin (voiceRampPosition), std::end (voiceRampPosition), s.voiceRampPosition);
+        s.numActiveVoices = numActiveVoices;
+        s.delayWrite = delayWrite;
+        s.numSilentFrames = numSilentFrames;
+        s.latencyWrite = latencyWrite;
+        s.historyWrite = historyWrite;
+        s.voiced = voiced;
+        std::copy (interpolatorState.begin(), interpolatorState.end(), s.interpolatorState.begin());
+        std::copy (latencyFrames.begin(), latencyFrames.end(), s.latencyFrames.begin());
+
+        s.numDelayFrames = std::min (numFrames, delayLine.getCapacity());
+        delayLine.readFrames (delayWrite, s.delayFrames.data(), s.numDelayFrames);
+    }
+
+    void restoreState() noexcept
+    {
+        const auto& s = savedState;
+
+        for (int i = 0; i < numRamps; ++i)
+            ramps[i] = s.ramps[i];
+
+        lfo = s.lfo;
+        currentInterpolation = s.interpolation;
+        std::copy (std::begin (s.voiceRampPosition), std::end (s.voiceRampPosition), voiceRampPosition);
+        numActiveVoices = s.numActiveVoices;
+        delayWrite = s.delayWrite;
+        numSilentFrames = s.numSilentFrames;
+        latencyWrite = s.latencyWrite;
+        historyWrite = s.historyWrite;
+        voiced = s.voiced;
+        std::copy (s.interpolatorState.begin(), s.interpolatorState.end(), interpolatorState.begin());
+        std::copy (s.latencyFrames.begin(), s.latencyFrames.end(), latencyFrames.begin());
+        delayLine.writeFrames (delayWrite, s.delayFrames.data(), s.numDelayFrames);
+    }
+
+    /** Switches factor mid-play, processing the first numSamples (no more than
+        blockLength) at both the old factor and the new one and crossfading
+        from one to the other. The old factor's render is only for its output,
+        so everything it changed is put back before the new one goes on from
+        where the old one started.
+    */
+    void crossfadeToFactor (int newFactor, SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples, int rampSamples) noexcept
+    {
+        const int oldFactor = oversamplingFactor;
+
+        // resampling rewrites the history that is being copied
+        abandonHistoryCopy();
+        updateLatencyPad();
+        updateDelayLineSize();
+        updateRampTargets (rampSamples < 0 ? -1 : rampSamples*oldFactor);
+
+        primeOversampler (spareOversampler, newFactor);
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            std::copy (channels[channel] + offset, channels[channel] + offset + numSamples, switchInput.data() + channel*blockLength);
+
+        saveState (numSamples*oldFactor);
+        processChunk (channels, numChannelsToProcess, offset, numSamples);
+
+        // the newest history, and the first few frames the old factor goes on to
+        // write, for resampleHistory()
+        const int numNewest = std::min (historyScratchFrames, delayLine.getCapacity()/2);
+        const int numAhead = std::min (std::min (historyAheadFrames, numSamples*oldFactor), delayLine.getCapacity()/2);
+        delayLine.readFrames (delayLine.wrap (savedState.delayWrite - numNewest), historyScratch.data(), numNewest + numAhead);
+        restoreState();
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            std::copy (channels[channel] + offset, channels[channel] + offset + numSamples, switchOutput.data() + channel*blockLength);
+            std::copy (switchInput.data() + channel*blockLength, switchInput.data() + channel*blockLength + numSamples, channels[channel] + offset);
+        }
+
+        setOversamplingFactor (newFactor);
+        changeRampRates ((double) newFactor/(double) oldFactor);
+        resampleHistory (oldFactor, numNewest, numAhead);
+        std::swap (oversampler, spareOversampler);
+
+        // the frames the new factor holds back for its latency come out of its
+        // filters a little after the old factor's do, which is where the old
+        // factor's output starts
+        latencyPad = getLatencyPad();
+        constexpr int mask = latencyRingSize - 1;
+
+        for (int i = 0; i < std::min (latencyPad, numSamples); ++i)
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+                latencyFrames[(size_t) (((latencyWrite - latencyPad + i) & mask)*numLanes + channel)] = switchOutput[(size_t) (channel*blockLength + i)];
+
+        processChunk (channels, numChannelsToProcess, offset, numSamples);
+
+        // an S-curve, so the new filters' first few samples, while they settle,
+        // are barely heard
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            const SampleType* from = switchOutput.data() + channel*blockLength;
+            SampleType* io = channels[channel] + offset;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const SampleType x = (SampleType) (i + 1)/(SampleType) numSamples;
+                io[i] = from[i] + (io[i] - from[i])*x*x*((SampleType) 3 - (SampleType) 2*x);
+            }
+        }
+    }
+
+    /** Starts filters again at factor from about where they would be had they
+        been running all along, so they don't have to settle as the crossfade
+        to them begins. The down path is primed with the last historySize
+        output frames, taken back up through the up path, and then the up path
+        with the last historySize input frames.
+    */
+    void primeOversampler (Oversampler<SampleType>& filters, int factor) noexcept
+    {
+        filters.reset();
+
+        if (factor == 1)
+            return;
+
+        forEachHistoryRun (outputHistory, historyWrite, [&] (const SampleType* src, int numFrames)
+        {
+            filters.upsample (src, frames.data(), numFrames, factor);
+            filters.downsample (frames.data(), baseFrames.data(), numFrames, factor);
+        });
+
+        filters.resetUpPath();
+
+        forEachHistoryRun (inputHistory, historyWrite, [&] (const SampleType* src, int numFrames)
+        {
+            filters.upsample (src, frames.data(), numFrames, factor);
+        });
+    }
+
+    /** Calls fn on a history ring's frames, oldest first, no more than blockLength at a time. */
+    template <typename Fn>
+    void forEachHistoryRun (const std::vector<SampleType>& ring, int write, Fn&& fn) const noexcept
+    {
+        for (int done = 0; done < historySize;)
+        {
+            const int index = (write + done) & (historySize - 1);
+            const int numFrames = std::min (std::min (blockLength, historySize - done), historySize - index);
+
+            fn (ring.data() + index*numLanes, numFrames);
+            done += numFrames;
+        }
+    }
+
+    /** Keeps the last historySize of the chunk's interleaved frames in one of the
+        rings for primeOversampler(): the input, or the output before the
+        latency pad. Once both are in, the rings are moved on past the chunk.
+    */
+    void rememberFrames (std::vector<SampleType>& ring, const SampleType* srcFrames, int numSamples) noexcept
+    {
+        const int numSkipped = std::max (0, numSamples - historySize);
+
+        for (int done = numSkipped; done < numSamples;)
+        {
+            const int index = (historyWrite + done) & (historySize - 1);
+            const int numFrames = std::min (numSamples - done, historySize - index);
+
+            std::copy (srcFrames + done*numLanes, srcFrames + (done + numFrames)*numLanes, ring.data() + index*numLanes);
+            done += numFrames;
+        }
+    }
+
+    /** Resamples the newest part of the delay line, as far back as the ramps and
+        voices can read, from oldFactor's rate to the current one in place, and
+        leaves the rest for clearStaleHistory(). Each new frame is interpolated from the old ones around
+        the same moment, shifted by the difference in the up filters' delay so
+        the history still lines up with the input that follows. The interpolation is the sinc kernel, and going down
+        in rate it is stretched into a lowpass at the new rate, so what the old
+        rate held above that doesn't alias.
+
+        With less delay at the new factor, the newest frames are from moments
+        the old factor had yet to write, so historyScratch holds the numNewest
+        frames before delayWrite followed by the numAhead frames the old factor
+        wrote next. Going up in rate the oldest frames are written first, and
+        going down the newest, so each write lands where nothing is read any
+        more, except among the newest few frames, which are read from
+        historyScratch.
+    */
+    void resampleHistory (int oldFactor, int numNewest, int numAhead) noexcept
+    {
+        const int capacity = delayLine.getCapacity();
+        const bool upwards = oversamplingFactor > oldFactor;
+        const int stretch = upwards ? 1 : oldFactor/oversamplingFactor;
+        const int numPhases = upwards ? oversamplingFactor/oldFactor : 1;
+        const int numTaps = std::min (8*stretch, capacity - 1), halfLength = numTaps/2;
+        const double ratio = (double) oldFactor/(double) oversamplingFactor;
+        const double shift = (oversampler.getUpLatency (oversamplingFactor) - oversampler.getUpLatency (oldFactor))*oldFactor;
+        const double minPosition = (double) (halfLength - numAhead), maxPosition = (double) (capacity - 1 - halfLength);
+        const int numToWrite = std::min (capacity - 1, getLongestReadSamples());
+
+        // every new frame in a phase has the same fraction, and so the same weights
+        for (int phase = 0; phase < numPhases; ++phase)
+        {
+            const double position = (double) phase*ratio + shift;
+            const double fraction = position - std::floor (position);
+            double sum = 0.0;
+
+            for (int j = 0; j < numTaps; ++j)
+                sum += InterpolationTables::windowedSinc ((double) (halfLength - j) - fraction, 0.9/stretch, (double) halfLength);
+
+            for (int j = 0; j < numTaps; ++j)
+                resampleWeights[phase][j] = (SampleType) (InterpolationTables::windowedSinc ((double) (halfLength - j) - fraction, 0.9/stretch, (double) halfLength)/sum);
+        }
+
+        SampleType* frame = delayed.data();
+        SampleType* wrappedTaps = frame + numLanes;
+
+        for (int i = 0; i < numToWrite; ++i)
+        {
+            const int back = upwards ? numToWrite - i : i + 1;
+            const double position = std::min (std::max ((double) back*ratio + shift, minPosition), maxPosition);
+            const int oldest = (int) std::floor (position) + halfLength;
+            const int index = delayLine.wrap (delayWrite - oldest);
+            const SampleType* taps;
+
+            // frame i of historyScratch is numNewest - i frames back. Further back
+            // the taps are read in place, unless they wrap round the end
+            if (oldest <= numNewest)
+                taps = historyScratch.data() + (numNewest - oldest)*numLanes;
+            else if (index + numTaps <= capacity + DelayLine<SampleType>::guardSize)
+                taps = delayLine.getReadPointer (index);
+            else
+                taps = wrappedTaps, delayLine.readFrames (index, wrappedTaps, numTaps);
+
+            const SampleType* weights = resampleWeights[back % numPhases];
+
+            for (int lane = 0; lane < numLanes; lane += Vector::size)
+            {
+                auto sum = Vector::broadcast (weights[0])*Vector::load (taps + lane);
+
+                for (int j = 1; j < numTaps; ++j)
+                    sum = sum + Vector::broadcast (weights[j])*Vector::load (taps + j*numLanes + lane);
+
+                sum.store (frame + lane);
+            }
+
+            delayLine.writeFrames (delayLine.wrap (delayWrite - back), frame, 1);
+        }
+
+        // nothing can read further back for now, and what's there is at the old
+        // rate, to be cleared over the next few chunks
+        numFreshFrames = numToWrite;
+        staleHistoryEnd = capacity;
+
+        // filtering can't make anything silent loud, but the count was in
+        // frames at the old rate
+        numSilentFrames = 0;
+    }
+
+    /** Clears the frames a factor switch left at the old rate behind the
+        resampled history, as far as the kernel can read and otherwise about as
+        much per chunk as copyHistoryStep() copies, so no one block pays for
+        clearing all of it.
+    */
+    void clearStaleHistory() noexcept
+    {
+        if (numFreshFrames >= staleHistoryEnd)
+            return;
+
+        const int numCleared = std::min (staleHistoryEnd, std::max (numFreshFrames + historyCopySamples/numLanes, getLongestReadSamples()));
+        delayLine.clearFrames (delayLine.wrap (delayWrite - numCleared), numCleared - numFreshFrames);
+        numFreshFrames = numCleared;
+    }
+
+    /** How far back the kernel can read, in samples, with the ramps and voices
+        heading where they are now: the longest delay plus the widest sweep,
+        and the interpolators' taps.
+    */
+    int getLongestReadSamples() const noexcept
+    {
+        float depth = 1.0f;
+
+        for (int v = 0; v < numActiveVoices; ++v)
+            depth = std::max (depth, std::max (std::abs (getVoiceCoefficient (voiceDepth, v)), std::abs (voiceTarget[voiceDepth][v])));
+
+        const float delay = std::max (ramps[delayRamp].getCurrentValue(), ramps[delayRamp].getTarget());
+        const float width = std::max (std::abs (ramps[widthRamp].getCurrentValue()), std::abs (ramps[widthRamp].getTarget()));
+        const float longest = std::min (std::max (delay, 0.0f), maxDelaySamples) + std::min (width*depth, maxDelaySamples);
+
+        return (int) std::min (longest, 2.0f*maxDelaySamples) + minDelaySamples + maxInterpolatorTaps + 2;
+    }
+
+    /** Carries the ramps and the voices over to a kernel rate ratio times the
+        old one, so they go on from the same values and arrive at the same time.
+    */
+    void changeRampRates (double ratio) noexcept
+    {
+        float targets[numRamps];
+        getRampTargets (targets);
+
+        for (int i = 0; i < numRamps; ++i)
+        {
+            float current = ramps[i].getCurrentValue();
+
+            // the delay is counted from minDelaySamples kernel samples behind the write head
+            if (i == delayRamp)
+                current = (current + (float) minDelaySamples)*(float) ratio - (float) minDelaySamples;
+            else if (i == widthRamp)
+                current *= (float) ratio;
+
+            ramps[i].changeRate (ratio, current, targets[i]);
+        }
+
+        for (int v = 0; v < maxCombVoices; ++v)
+        {
+            if (! isVoiceRamping (v))
+                continue;
+
+            const int numRampFrames = std::max (1, (int) std::lround ((voiceRampLength[v] - voiceRampPosition[v])*ratio));
+
+            for (int c = 0; c < numVoiceCoefficients; ++c)
+            {
+                voiceStart[c][v] = getVoiceCoefficient (c, v);
+                voiceStep[c][v] = (voiceTarget[c][v] - voiceStart[c][v])/(float) numRampFrames;
+            }
+
+            voiceRampLength[v] = numRampFrames;
+            voiceRampPosition[v] = 0;
+        }
+    }
+
+    /** Sets the ramp targets from params, to be reached after rampFrames kernel
+        samples, or after rampSeconds if that is negative.
+    */
+    void updateRampTargets (int rampFrames) noexcept
+    {
+        // while idle nothing is rendered, so the ramps jump straight to their
+        // targets ready for when processing resumes
+        snapRamps = snapRamps || idle;
+
+        float targets[numRamps];
+        getRampTargets (targets);
+
+        for (int i = 0; i < numRamps; ++i)
+        {
+            if (snapRamps)
+                ramps[i].setCurrentAndTarget (targets[i]);
+            else if (rampFrames >= 0)
+                ramps[i].setTarget (targets[i], rampFrames);
+            else
+                ramps[i].setTarget (targets[i]);
+        }
+
+        updateVoiceTargets (rampFrames);
+        snapRamps = false;
+        lfo.setFrequency (params.lfoFreq);
+    }
+
+    /** The ramps' targets for params at the current factor. */
+    void getRampTargets (float* targets) const noexcept
+    {
+        // the read head's minimum gap is in kernel samples, so when oversampling the
+        // difference is made up here to keep the comb spacing the same at every factor
+        targets[delayRamp] = params.delay*(float)sampleRate + (float) (minDelaySamples*(oversamplingFactor - 1));
+        targets[widthRamp] = params.sweepWidth*(float)sampleRate;
+        targets[bleedRamp] = params.bleed;
+        targets[feedforwardRamp] = params.feedforward;
+        targets[feedbackRamp] = params.feedback;
+        targets[tremoloRamp] = params.tremolo ? 1.0f : 0.0f;
+    }
+
+    /** Sets the voices' coefficient targets from params, ramping like updateRampTargets(). */
+    void updateVoiceTargets (int rampFrames) noexcept
+    {
+        const int numVoices = std::min (std::max (params.voices, 1), maxCombVoices);
+        const int numRampFrames = rampFrames >= 0 ? std::max (1, rampFrames) : std::max (1, (int) (rampSeconds*sampleRate));
+
+        for (int v = 0; v < maxCombVoices; ++v)
+        {
+            // a silent voice's allpass state follows the first voice's, so it
+            // starts from there when it fades back in
+            if (v > 0 && isVoiceSilent (v) && ! interpolatorState.empty())
+                std::copy (interpolatorState.begin(), interpolatorState.begin() + numLanes, interpolatorState.begin() + v*numLanes);
+
+            float targets[numVoiceCoefficients] = { voiceTarget[voiceCos][v], voiceTarget[voiceSin][v], voiceTarget[voiceDepth][v], 0.0f };
+
+            if (v < numVoices)
+            {
+                const double angle = 6.283185307179586*(double) params.voicePhase[v];
+                targets[voiceCos] = (float) std::cos (angle);
+                targets[voiceSin] = (float) std::sin (angle);
+                targets[voiceDepth] = params.voiceDepth[v];
+                targets[voiceGain] = 1.0f/(float) numVoices;
+            }
+
+            float current[numVoiceCoefficients];
+            bool changed = false, moving = false;
+
+            for (int c = 0; c < numVoiceCoefficients; ++c)
+            {
+                current[c] = getVoiceCoefficient (c, v);
+                changed = changed || targets[c] != voiceTarget[c][v];
+                moving = moving || targets[c] != current[c];
+            }
+
+            // a silent voice can take its new shape straight away and just fade in
+            if (current[voiceGain] == 0.0f && ! isVoiceRamping (v))
+                for (int c = 0; c < voiceGain; ++c)
+                    current[c] = targets[c];
+
+            // a timed change to where the voice already is ends any ramp there,
+            // and one to where it is already heading leaves the ramp alone
+            if (snapRamps || (rampFrames >= 0 && ! moving))
+            {
+                voiceRampLength[v] = voiceRampPosition[v] = 0;
+            }
+            else if (changed)
+            {
+                voiceRampLength[v] = numRampFrames;
+                voiceRampPosition[v] = 0;
+
+                for (int c = 0; c < numVoiceCoefficients; ++c)
+                {
+                    voiceStart[c][v] = current[c];
+                    voiceStep[c][v] = (targets[c] - current[c])/(float) numRampFrames;
+                }
+            }
+
+            for (int c = 0; c < numVoiceCoefficients; ++c)
+                voiceTarget[c][v] = targets[c];
+        }
+
+        updateNumActiveVoices();
+    }
+
+    bool isVoiceRamping (int voice) const noexcept      { return voiceRampPosition[voice] < voiceRampLength[voice]; }
+    bool isVoiceSilent (int voice) const noexcept       { return getVoiceCoefficient (voiceGain, voice) == 0.0f && voiceTarget[voiceGain][voice] == 0.0f; }
+
+    /** A voice's coefficient where the ramp has got to. */
+    float getVoiceCoefficient (int coefficient, int voice) const noexcept
+    {
+        return isVoiceRamping (voice) ? voiceStart[coefficient][voice] + voiceStep[coefficient][voice]*(float) voiceRampPosition[voice]
+                                      : voiceTarget[coefficient][voice];
+    }
+
+    /** Moves the voices' ramps on by numFrames kernel samples. */
+    void advanceVoices (int numFrames) noexcept
+    {
+        for (int v = 0; v < maxCombVoices; ++v)
+            voiceRampPosition[v] = std::min (voiceRampLength[v], voiceRampPosition[v] + numFrames);
+
+        updateNumActiveVoices();
+    }
+
+    void updateNumActiveVoices() noexcept
+    {
+        numActiveVoices = 1;
+
+        for (int v = 1; v < maxCombVoices; ++v)
+            if (! isVoiceSilent (v))
+                numActiveVoices = v + 1;
+    }
+
+    /** True if the next numFrames need the voices worked out separately. One voice
+        that follows the LFO as it is, or any number of them with no modulation
+        (so that they all read the same tap, and their gains add up to 1), only
+        need the single tap. The allpass keeps state for each voice, so for it only
+        the first case holds.
+    */
+    bool needsVoices (int numFrames) const noexcept
+    {
+        for (int v = 0; v < numActiveVoices; ++v)
+            if (isVoiceRamping (v))
+                return true;
+
+        if (currentInterpolation != InterpolationQuality::allpass
+             && ramps[widthRamp].wasSettledFor (numFrames) && ramps[widthRamp].getTarget() == 0.0f)
+            return false;
+
+        return numActiveVoices > 1
+            || voiceTarget[voiceCos][0] != 1.0f || voiceTarget[voiceSin][0] != 0.0f
+            || voiceTarget[voiceDepth][0] != 1.0f || voiceTarget[voiceGain][0] != 1.0f;
+    }
+
+    void processChunk (SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples) noexcept
+    {
+        // numSamples is at the host rate, numFrames at the kernel rate
+        const int numFrames = numSamples*oversamplingFactor;
+
+        if (hasDecayed() && isInputSilent (channels, numChannelsToProcess, offset, numSamples))
+        {
+            if (! idle)
+            {
+                clearSignalState();
+                idle = true;
+            }
+
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+                std::fill (channels[channel] + offset, channels[channel] + offset + numSamples, SampleType());
+
+            lfo.skip (numFrames);
+            return;
+        }
+
+        idle = false;
+
+        for (int i = 0; i < numRamps; ++i)
+            rampValues[i] = ramps[i].render (numFrames);
+
+        clearStaleHistory();
+
+        if (params.interpolation != currentInterpolation)
+        {
+            std::fill (interpolatorState.begin(), interpolatorState.end(), SampleType());
+            currentInterpolation = params.interpolation;
+        }
+
+        const bool wasVoiced = voiced;
+        voiced = needsVoices (numFrames);
+
+        // while one voice read the single tap, the others were silent and
+        // their interpolator state followed its
+        if (voiced && ! wasVoiced)
+            for (int v = 1; v < maxCombVoices; ++v)
+                std::copy (interpolatorState.begin(), interpolatorState.begin() + numLanes, interpolatorState.begin() + v*numLanes);
+
+        lfo.render (lfoValues.data(), voiced ? quadratureValues.data() : nullptr, numFrames);
+
+        if (oversamplingFactor > 1)
+        {
+            interleave (baseFrames.data(), channels, numChannelsToProcess, offset, numSamples);
+            oversampler.upsample (baseFrames.data(), frames.data(), numSamples, oversamplingFactor);
+        }
+        else
+        {
+            interleave (frames.data(), channels, numChannelsToProcess, offset, numSamples);
+        }
+
+        const bool keepsHistory = params.oversampling == OversamplingMode::automatic;
+
+        if (keepsHistory)
+            rememberFrames (inputHistory, oversamplingFactor > 1 ? baseFrames.data() : frames.data(), numSamples);
+
+        switch (currentInterpolation)
+        {
+            case InterpolationQuality::cubic:     processWith<CubicInterpolator<SampleType>> (numFrames); break;
+            case InterpolationQuality::allpass:   processWith<AllpassInterpolator<SampleType>> (numFrames); break;
+            case InterpolationQuality::sinc:      processWith<SincInterpolator<SampleType>> (numFrames); break;
+            case InterpolationQuality::linear:
+            case InterpolationQuality::numQualities:
+            default:                              processWith<LinearInterpolator<SampleType>> (numFrames); break;
+        }
+
+        advanceVoices (numFrames);
+        trackWrittenPeak (numFrames);
+        numFreshFrames = std::min (numFreshFrames + numFrames, staleHistoryEnd);
+
+        if (oversamplingFactor > 1)
+        {
+            oversampler.downsample (frames.data(), baseFrames.data(), numSamples, oversamplingFactor);
+
+            if (keepsHistory)
+                rememberFrames (outputHistory, baseFrames.data(), numSamples);
+
+            padLatency (baseFrames.data(), numSamples);
+            deinterleave (baseFrames.data(), channels, numChannelsToProcess, offset, numSamples);
+        }
+        else
+        {
+            if (keepsHistory)
+                rememberFrames (outputHistory, frames.data(), numSamples);
+
+            padLatency (frames.data(), numSamples);
+            deinterleave (frames.data(), channels, numChannelsToProcess, offset, numSamples);
+        }
+
+        if (keepsHistory)
+            historyWrite = (historyWrite + numSamples) & (historySize - 1);
+    }
+
+    enum Path { recursivePath, longDelayPath, feedforwardPath };
+
+    /**
+        Read positions in samples as 32-bit fixed point, with as many bits of
+        fraction as the delay line's length leaves room for: 15 for 550 ms at
+        48 kHz, 13 at 192 kHz. The delay and its modulation are each truncated
+        to fixed point on their own and then added exactly, so a long delay
+        doesn't round away the fraction of the modulation. The sum is clamped
+        to the delay line, and the whole part and the fraction come out with a
+        shift and a mask. Everything stays in 32-bit lanes, so the position
+        loops still vectorise, which 64-bit conversions wouldn't below AVX-512.
+    */
+    struct ReadPositionFormat
+    {
+        int fractionBits = 0, minPosition = 0, maxPosition = 0, offset = 0;
+        float scale = 1.0f, inverseScale = 1.0f, maxDelay = 0.0f;
+
+        /** The position delay plus modulation samples back, clamped to the
+            delay line, then moved on by offset.
+        */
+        int toPosition (float delay, float modulation) const noexcept
+        {
+            const int position = (int) (std::min (std::max (delay, 0.0f), maxDelay)*scale)
+                               + (int) (std::min (std::max (modulation, -maxDelay), maxDelay)*scale);
+
+            return std::min (std::max (position, minPosition), maxPosition) + offset;
+        }
+
+        int wholeOf (int position) const noexcept          { return position >> fractionBits; }
+        float fractionOf (int position) const noexcept     { return (float) (position & ((1 << fractionBits) - 1))*inverseScale; }
+    };
+
+    /** The format for the current maximum delay, allowing no less than minWholeDelay
+        and moving positions on by an interpolator's positionOffset.
+    */
+    ReadPositionFormat getReadPositionFormat (int minWholeDelay, float positionOffset) const noexcept
+    {
+        auto format = readPositionFormat;
+        format.minPosition = std::min (minWholeDelay << format.fractionBits, format.maxPosition);
+        format.offset = (int) (positionOffset*format.scale);
+        return format;
+    }
+
+    template <class Interpolator>
+    void processWith (int numSamples) noexcept
+    {
+        // taps newer than the read position have to exist already
+        constexpr int minWholeDelay = std::max (0, Interpolator::numNewerTaps + 1 - minDelaySamples);
+        constexpr int numOlderTaps = Interpolator::numTaps - 1 - Interpolator::numNewerTaps;
+
+        const float* delaySamples = rampValues[delayRamp];
+        const float* widthSamples = rampValues[widthRamp];
+        const float* tremoloDepth = rampValues[tremoloRamp];
+        const float* lfoData = lfoValues.data();
+        const auto format = getReadPositionFormat (minWholeDelay, Interpolator::positionOffset);
+        int minReadOffset = std::numeric_limits<int>::max(), maxReadOffset = 0;
+
+        if (voiced)
+        {
+            renderVoicePositions<numOlderTaps> (format, numSamples, minReadOffset, maxReadOffset);
+        }
+        else
+        {
+            int* offsets = readOffsets.data();
+            float* fracs = fractions.data();
+            int minOffset = minReadOffset, maxOffset = maxReadOffset;
+
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                // computing M[n] in samples. The read position dpw - minDelay - M[n] is
+                // split into whole and fractional parts relative to dpw, which keeps
+                // the fraction precise however far round the buffer dpw is
+                const int position = format.toPosition (delaySamples[sample], widthSamples[sample]*lfoData[sample]);
+
+                // offset back from dpw to the oldest tap
+                const int offset = minDelaySamples + format.wholeOf (position) + numOlderTaps;
+                offsets[sample] = offset;
+                fracs[sample] = format.fractionOf (position);
+                minOffset = std::min (minOffset, offset);
+                maxOffset = std::max (maxOffset, offset);
+            }
+
+            minReadOffset = minOffset;
+            maxReadOffset = maxOffset;
+        }
+
+        // tremolo fades in and out rather than switching
+        for (int sample = 0; sample < numSamples; ++sample)
+            outputGains[(size_t) sample] = 1.0f + tremoloDepth[sample]*(lfoData[sample] - 1.0f);
+
+        // the block paths write the whole block to the delay line at once, which
+        // mustn't overwrite anything still to be read
+        const bool fitsInDelayLine = maxReadOffset + numSamples <= delayLine.getCapacity();
+        auto path = recursivePath;
+
+        if (fitsInDelayLine && ramps[feedbackRamp].wasSettledFor (numSamples) && ramps[feedbackRamp].getTarget() == 0.0f)
+            path = feedforwardPath;
+        else if (fitsInDelayLine && minReadOffset >= numSamples + Interpolator::numTaps - 1)
+            path = longDelayPath;
+
+        // an unmodulated delay reads one contiguous run of taps
+        staticTaps = ramps[delayRamp].wasSettledFor (numSamples)
+                  && ramps[widthRamp].wasSettledFor (numSamples)
+                  && ramps[widthRamp].getTarget() == 0.0f;
+
+        switch (numLanes/Vector::size)
+        {
+            case 1:   processFrames<Interpolator, 1> (numSamples, path); break;
+            case 2:   processFrames<Interpolator, 2> (numSamples, path); break;
+            case 3:   processFrames<Interpolator, 3> (numSamples, path); break;
+            case 4:   processFrames<Interpolator, 4> (numSamples, path); break;
+            default:  processFrames<Interpolator, 0> (numSamples, path); break;
+        }
+    }
+
+    /** Works out every voice's read offset, fraction and gain for each of the
+        next numSamples, as processWith() does for a single tap, and widens the
+        range of read offsets to cover the active ones. The voices sit side by
+        side in fixed-size arrays, so the inner loop runs across all of them at
+        once in SIMD lanes, active or not.
+    */
+    template <int NumOlderTaps>
+    void renderVoicePositions (const ReadPositionFormat format, int numSamples, int& minReadOffset, int& maxReadOffset) noexcept
+    {
+        constexpr int n = maxCombVoices;
+        const float* delaySamples = rampValues[delayRamp];
+        const float* widthSamples = rampValues[widthRamp];
+        const float* lfoData = lfoValues.data();
+        const float* quadratureData = quadratureValues.data();
+
+        // local copies, which the compiler knows nothing else writes to
+        float start[numVoiceCoefficients][n], step[numVoiceCoefficients][n], target[numVoiceCoefficients][n];
+        int position[n], length[n], minOffsets[n], maxOffsets[n];
+
+        for (int v = 0; v < n; ++v)
+        {
+            for (int c = 0; c < numVoiceCoefficients; ++c)
+            {
+                start[c][v] = voiceStart[c][v];
+                step[c][v] = voiceStep[c][v];
+                target[c][v] = voiceTarget[c][v];
+            }
+
+            position[v] = voiceRampPosition[v];
+            length[v] = voiceRampLength[v];
+            minOffsets[v] = std::numeric_limits<int>::max();
+            maxOffsets[v] = 0;
+        }
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            int* offsets = voiceReadOffsets.data() + sample*n;
+            float* fracs = voiceFractions.data() + sample*n;
+            float* gains = voiceGains.data() + sample*n;
+            const float lfoValue = lfoData[sample], quadrature = quadratureData[sample];
+            const float delay = delaySamples[sample], width = widthSamples[sample];
+            float modulation[n];
+
+            for (int v = 0; v < n; ++v)
+            {
+                // the coefficients as getVoiceCoefficient() will have them after this sample
+                const int stepsTaken = position[v] + sample + 1;
+                const bool ramping = stepsTaken < length[v];
+                const float t = (float) stepsTaken;
+                const float c = ramping ? start[voiceCos][v] + step[voiceCos][v]*t : target[voiceCos][v];
+                const float s = ramping ? start[voiceSin][v] + step[voiceSin][v]*t : target[voiceSin][v];
+                const float depth = ramping ? start[voiceDepth][v] + step[voiceDepth][v]*t : target[voiceDepth][v];
+
+                // the LFO at the voice's phase offset. At no offset this is exactly lfo
+                const float voiceLfo = lfoValue*c + quadrature*s + 0.5f*(1.0f - c);
+                modulation[v] = width*depth*voiceLfo;
+                gains[v] = ramping ? start[voiceGain][v] + step[voiceGain][v]*t : target[voiceGain][v];
+            }
+
+            // a separate pass, with no branches, so this part at least runs in SIMD lanes
+            for (int v = 0; v < n; ++v)
+            {
+                const int readPosition = format.toPosition (delay, modulation[v]);
+                const int offset = minDelaySamples + format.wholeOf (readPosition) + NumOlderTaps;
+
+                offsets[v] = offset;
+                fracs[v] = format.fractionOf (readPosition);
+                minOffsets[v] = std::min (minOffsets[v], offset);
+                maxOffsets[v] = std::max (maxOffsets[v], offset);
+            }
+        }
+
+        for (int v = 0; v < numActiveVoices; ++v)
+        {
+            minReadOffset = std::min (minReadOffset, minOffsets[v]);
+            maxReadOffset = std::max (maxReadOffset, maxOffsets[v]);
+        }
+    }
+
+    /** Runs the comb over the interleaved frames, NumVectors SimdVectors per frame
+        (or numLanes/Vector::size if NumVectors is 0).
+    */
+    template <class Interpolator, int NumVectors>
+    void processFrames (int numSamples, Path path) noexcept
+    {
+        if (path == feedforwardPath)
+        {
+            // xh[n] = x[n], so the delay line gets the input block as is and every
+            // tap is then available before it is read
+            delayLine.writeFrames (delayWrite, frames.data(), numSamples);
+            readTaps<Interpolator, NumVectors> (numSamples);
+            mixBlock<NumVectors, false> (numSamples);
+        }
+        else if (path == longDelayPath)
+        {
+            readTaps<Interpolator, NumVectors> (numSamples);
+            mixBlock<NumVectors, true> (numSamples);
+            delayLine.writeFrames (delayWrite, delayed.data(), numSamples);
+        }
+        else
+        {
+            processRecursive<Interpolator, NumVectors> (numSamples);
+            return;
+        }
+
+        delayWrite = delayLine.wrap (delayWrite + numSamples);
+    }
+
+    /** Fills delayed with the interpolated tap xh[n-M] of every frame in the block. */
+    template <class Interpolator, int NumVectors>
+    void readTaps (int numSamples) noexcept
+    {
+        if (voiced)
+        {
+            Interpolator interpolator (*tables);
+
+            for (int sample = 0; sample < numSamples; ++sample)
+                sumVoiceTaps<Interpolator, NumVectors> (interpolator, delayWrite + sample, sample, delayed.data() + sample*numLanes);
+
+            return;
+        }
+
+        if (std::is_same<Interpolator, LinearInterpolator<SampleType>>::value && staticTaps)
+        {
+            const auto frac = Vector::broadcast ((SampleType) fractions[0]);
+            int index = delayLine.wrap (delayWrite - readOffsets[0]);
+
+            for (int done = 0; done < numSamples;)
+            {
+                const int numInRun = std::min (numSamples - done, delayLine.getCapacity() - index);
+                const SampleType* src = delayLine.getReadPointer (index);
+                SampleType* dest = delayed.data() + done*numLanes;
+
+                for (int i = 0; i < numInRun*numLanes; i += Vector::size)
+                {
+                    const auto older = Vector::load (src + i);
+                    const auto newer = Vector::load (src + numLanes + i);
+                    (newer + frac*(older - newer)).store (dest + i);
+                }
+
+                done += numInRun;
+                index = 0;
+            }
+
+            return;
+        }
+
+        const int numVectors = NumVectors > 0 ? NumVectors : numLanes/Vector::size;
+        Interpolator interpolator (*tables);
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            const SampleType* taps = delayLine.getReadPointer (delayLine.wrap (delayWrite + sample - readOffsets[(size_t) sample]));
+            SampleType* dest = delayed.data() + sample*numLanes;
+
+            interpolator.setDelay (fractions[(size_t) sample]);
+
+            for (int v = 0; v < numVectors; ++v)
+            {
+                const int lane = v*Vector::size;
+                interpolator.interpolate (taps + lane, numLanes, interpolatorState.data() + lane).store (dest + lane);
+            }
+        }
+    }
+
+    /** Writes the gain-weighted sum of every active voice's tap for one frame,
+        read back from write index dpw, to dest.
+    */
+    template <class Interpolator, int NumVectors>
+    void sumVoiceTaps (Interpolator& interpolator, int dpw, int sample, SampleType* dest) noexcept
+    {
+        const int numVectors = NumVectors > 0 ? NumVectors : numLanes/Vector::size;
+        const int* offsets = voiceReadOffsets.data() + sample*maxCombVoices;
+        const float* fracs = voiceFractions.data() + sample*maxCombVoices;
+        const float* gains = voiceGains.data() + sample*maxCombVoices;
+
+        for (int voice = 0; voice < numActiveVoices; ++voice)
+        {
+            const SampleType* taps = delayLine.getReadPointer (delayLine.wrap (dpw - offsets[voice]));
+            SampleType* state = interpolatorState.data() + voice*numLanes;
+            const auto gain = Vector::broadcast ((SampleType) gains[voice]);
+
+            interpolator.setDelay (fracs[voice]);
+
+            for (int v = 0; v < numVectors; ++v)
+            {
+                const int lane = v*Vector::size;
+                auto tap = gain*interpolator.interpolate (taps + lane, numLanes, state + lane);
+
+                if (voice > 0)
+                    tap = tap + Vector::load (dest + lane);
+
+                tap.store (dest + lane);
+            }
+        }
+    }
+
+    /** Mixes the input frames with the taps in delayed. With feedback, xh replaces
+        the taps in delayed, ready to be written to the delay line.
+    */
+    template <int NumVectors, bool WithFeedback>
+    void mixBlock (int numSamples) noexcept
+    {
+        const int numVectors = NumVectors > 0 ? NumVectors : numLanes/Vector::size;
+        const float* bl = rampValues[bleedRamp];
+        const float* ff = rampValues[feedforwardRamp];
+        const float* fb = rampValues[feedbackRamp];
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            SampleType* frame = frames.data() + sample*numLanes;
+            SampleType* tap = delayed.data() + sample*numLanes;
+            const auto fbv = Vector::broadcast ((SampleType) fb[sample]);
+            const auto ffv = Vector::broadcast ((SampleType) ff[sample]);
+            const auto blv = Vector::broadcast ((SampleType) bl[sample]);
+            const auto gain = Vector::broadcast ((SampleType) outputGains[(size_t) sample]);
+
+            for (int v = 0; v < numVectors; ++v)
+            {
+                const int lane = v*Vector::size;
+                const auto interpolated = Vector::load (tap + lane);
+                auto xh = Vector::load (frame + lane);
+
+                if (WithFeedback)
+                {
+                    xh = xh + fbv*interpolated;
+                    xh.store (tap + lane);
+                }
+
+                (gain*(blv*xh + ffv*interpolated)).store (frame + lane);
+            }
+        }
+    }
+
+    template <class Interpolator, int NumVectors>
+    void processRecursive (int numSamples) noexcept
+    {
+        const int numVectors = NumVectors > 0 ? NumVectors : numLanes/Vector::size;
+        const float* bl = rampValues[bleedRamp];
+        const float* ff = rampValues[feedforwardRamp];
+        const float* fb = rampValues[feedbackRamp];
+        const int mask = delayLine.getMask();
+        const bool isVoiced = voiced;
+        int dpw = delayWrite;
+        Interpolator interpolator (*tables);
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            const SampleType* taps = nullptr;
+            SampleType* frame = frames.data() + sample*numLanes;
+            SampleType* voiceSum = delayed.data() + sample*numLanes;
+            SampleType* write = delayLine.getWritePointer (dpw);
+            SampleType* mirror = delayLine.getMirrorPointer (dpw);
+
+            // with several voices their taps are summed first, into the frame's
+            // slot in delayed, which this path doesn't otherwise use
+            if (isVoiced)
+            {
+                sumVoiceTaps<Interpolator, NumVectors> (interpolator, dpw, sample, voiceSum);
+            }
+            else
+            {
+                taps = delayLine.getReadPointer (delayLine.wrap (dpw - readOffsets[(size_t) sample]));
+                interpolator.setDelay (fractions[(size_t) sample]);
+            }
+
+            const auto fbv = Vector::broadcast ((SampleType) fb[sample]);
+            const auto ffv = Vector::broadcast ((SampleType) ff[sample]);
+            const auto blv = Vector::broadcast ((SampleType) bl[sample]);
+            const auto gain = Vector::broadcast ((SampleType) outputGains[(size_t) sample]);
+
+            for (int v = 0; v < numVectors; ++v)
+            {
+                const int lane = v*Vector::size;
+                const auto interpolated = isVoiced ? Vector::load (voiceSum + lane)
+                                                   : interpolator.interpolate (taps + lane, numLanes, interpolatorState.data() + lane);
+
+                const auto xh = Vector::load (frame + lane) + fbv*interpolated;     // xh[n] = x[n] + fb*xh[n-M]
+                const auto out = blv*xh + ffv*interpolated;                             // y[n] = bl*xh[n] + ff*xh[n-M]
+
+                xh.store (write + lane);
+                xh.store (mirror + lane);
+                (gain*out).store (frame + lane);
+            }
+
+            // increment write pointer, loop if necessary
+            dpw = (dpw + 1) & mask;
+        }
+
+        delayWrite = dpw;
+    }
+
+    // Channels are moved in and out of the frames four at a time, as 4x4 transposes
+    // of four samples from each, with anything left over copied one by one.
+
+    void interleave (SampleType* destFrames, const SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples) const noexcept
+    {
+        constexpr int n = Vector::size;
+        const int numGroupedChannels = numChannelsToProcess/n*n;
+        const int numGroupedSamples = numSamples/n*n;
+
+        if (numChannelsToProcess < numLanes)
+            std::fill (destFrames, destFrames + numSamples*numLanes, SampleType());
+
+        for (int channel = 0; channel < numGroupedChannels; channel += n)
+        {
+            const SampleType* src0 = channels[channel] + offset;
+            const SampleType* src1 = channels[channel + 1] + offset;
+            const SampleType* src2 = channels[channel + 2] + offset;
+            const SampleType* src3 = channels[channel + 3] + offset;
+
+            for (int sample = 0; sample < numGroupedSamples; sample += n)
+            {
+                auto a = Vector::load (src0 + sample), b = Vector::load (src1 + sample);
+                auto c = Vector::load (src2 + sample), d = Vector::load (src3 + sample);
+                Vector::transpose (a, b, c, d);
+
+                SampleType* dest = destFrames + sample*numLanes + channel;
+                a.store (dest);
+                b.store (dest + numLanes);
+                c.store (dest + numLanes*2);
+                d.store (dest + numLanes*3);
+            }
+        }
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            const SampleType* src = channels[channel] + offset;
+            SampleType* dest = destFrames + channel;
+
+            for (int sample = channel < numGroupedChannels ? numGroupedSamples : 0; sample < numSamples; ++sample)
+                dest[sample*numLanes] = src[sample];
+        }
+    }
+
+    void deinterleave (const SampleType* srcFrames, SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples) const noexcept
+    {
+        constexpr int n = Vector::size;
+        const int numGroupedChannels = numChannelsToProcess/n*n;
+        const int numGroupedSamples = numSamples/n*n;
+
+        for (int channel = 0; channel < numGroupedChannels; channel += n)
+        {
+            SampleType* dest0 = channels[channel] + offset;
+            SampleType* dest1 = channels[channel + 1] + offset;
+            SampleType* dest2 = channels[channel + 2] + offset;
+            SampleType* dest3 = channels[channel + 3] + offset;
+
+            for (int sample = 0; sample < numGroupedSamples; sample += n)
+            {
+                const SampleType* src = srcFrames + sample*numLanes + channel;
+                auto a = Vector::load (src), b = Vector::load (src + numLanes);
+                auto c = Vector::load (src + numLanes*2), d = Vector::load (src + numLanes*3);
+                Vector::transpose (a, b, c, d);
+
+                a.store (dest0 + sample);
+                b.store (dest1 + sample);
+                c.store (dest2 + sample);
+                d.store (dest3 + sample);
+            }
+        }
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            const SampleType* src = srcFrames + channel;
+            SampleType* dest = channels[channel] + offset;
+
+            for (int sample = channel < numGroupedChannels ? numGroupedSamples : 0; sample < numSamples; ++sample)
+                dest[sample] = src[sample*numLanes];
+        }
+    }
+
+    static constexpr int maxInterpolatorTaps = SincInterpolator<SampleType>::numTaps;
+
+    CombParameters params;
+    DelayLine<SampleType> delayLine;
+
+    // grownDelayLine belongs to growDelayLine() in the noGrowth and retired
+    // states, and to process() in the grown state
+    enum GrowthState { noGrowth, grown, retired };
+    DelayLine<SampleType> grownDelayLine;
+    std::atomic<int> growthState { noGrowth }, requiredCapacity { 0 };
+    int historyCopied = -1, historyStart = 0, historyWritten = 0, lastDelayWrite = 0;
+    std::mutex growthLock;
+    std::shared_ptr<const InterpolationTables> tables;
+    InterpolationQuality currentInterpolation = InterpolationQuality::linear;
+    double hostSampleRate = 44100.0, sampleRate = 44100.0;     // sampleRate is the kernel rate
+    float maxDelaySamples = 0.0f;
+    ReadPositionFormat readPositionFormat;
+    int numChannels = 1, numLanes = Vector::size, delayWrite = 0;
+    int oversamplingFactor = 1, maxFactor = Oversampler<SampleType>::maxFactor, numSilentFrames = 0;
+    bool idle = false;
+    CombLfo lfo;
+    Oversampler<SampleType> oversampler, spareOversampler;
+
+    ParameterRamp ramps[numRamps];
+    const float* rampValues[numRamps] = {};
+    std::vector<float> lfoValues, quadratureValues, fractions, outputGains;
+    std::vector<SampleType> frames, delayed, baseFrames, interpolatorState;
+
+    // the last few output frames, for padLatency(). The ring is longer than any
+    // filter latency
+    static constexpr int latencyRingSize = 8;
+    std::vector<SampleType> latencyFrames;
+    int latencyPad = 0, latencyWrite = 0;
+
+    // getLatencySamples() for each mode, for any thread
+    static constexpr int numOversamplingModes = (int) OversamplingMode::automatic + 1;
+    std::atomic<int> modeLatencySamples[numOversamplingModes] = {};
+
+    // for switching factor in automatic mode: the last few input and output
+    // frames, to prime the new filters with, and room for crossfadeToFactor()
+    // to keep what it renders at the old factor and the state to go back to
+    static constexpr int historySize = 128, historyScratchFrames = 64, historyAheadFrames = 32;
+    std::vector<SampleType> inputHistory, outputHistory, historyScratch, switchInput, switchOutput;
+    int historyWrite = 0;
+    SavedState savedState;
+
+    // after a switch, back positions numFreshFrames + 1 to staleHistoryEnd
+    // still hold frames at the old rate
+    int numFreshFrames = 0, staleHistoryEnd = 0;
+    SampleType resampleWeights[Oversampler<SampleType>::maxFactor][8*Oversampler<SampleType>::maxFactor];
+
+    std::vector<int> readOffsets;
+    int blockLength = 1;
+    bool snapRamps = true, staticTaps = false;
+
+    // Each voice's LFO is lfo*cos + quadrature*sin + 0.5*(1 - cos) for its phase
+    // offset, depth scales its sweep and gain weights its tap. The coefficients
+    // are kept one array per kind, voices side by side. A voice's four ramp
+    // together in a straight line from start, reaching start + step*k after k
+    // samples whatever the chunk sizes, and are at the target once k gets to
+    // the ramp's length.
+    enum VoiceCoefficient { voiceCos, voiceSin, voiceDepth, voiceGain, numVoiceCoefficients };
+    float voiceStart[numVoiceCoefficients][maxCombVoices] = {};
+    float voiceTarget[numVoiceCoefficients][maxCombVoices] = {};
+    float voiceStep[numVoiceCoefficients][maxCombVoices] = {};
+    int voiceRampLength[maxCombVoices] = {}, voiceRampPosition[maxCombVoices] = {};
+    int numActiveVoices = 1;
+    bool voiced = false;
+
+    // per frame, maxCombVoices entries each
+    std::vector<float> voiceFractions, voiceGains;
+    std::vector<int> voiceReadOffsets;
+};
+
+#if COMB_EXTERN_TEMPLATES
+extern template class CombEngine<float>;
+extern template class CombEngine<double>;
+#endif
@@ -0,0 +1,267 @@
+/*
+  ==============================================================================
+
+    CombLfo.h
+
+    Low-cost sine LFO for CombEngine, rendered a block at a time.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//==============================================================================
+/**
+    Unipolar sine LFO, lfo[n] = 0.5 + 0.5*sin(2*pi*phase[n]).
+
+    Each block is rendered once into a buffer that every channel then reads. The
+    samples come from a recursive quadrature (rotating phasor) oscillator that
+    is re-seeded from the exact phase every seedInterval samples, so its
+    rounding error never builds up and a sin/cos pair is only needed every so
+    often. The seeds fall on a grid counted from the last reset, setPhase(),
+    skip() or change of frequency rather than from the start of each block, so
+    the output doesn't depend on how the audio is split into blocks.
+
+    The phase is a 0.64 fixed-point fraction of a cycle, so it wraps by simply
+    overflowing and advances by an exact integer increment every sample. Unlike
+    a floating-point phase it keeps the same resolution all the way round the
+    cycle, and never drifts from rounding however long it runs.
+
+    In control-rate mode the oscillator only runs every controlInterval samples
+    and the values in between are linearly interpolated. It is seeded at the
+    start of every block instead.
+
+    render() can also give the quadrature 0.5*cos(2*pi*phase[n]) alongside, which
+    the oscillator has anyway. From the pair, a copy of the LFO at any phase
+    offset o is lfo*cos(2*pi*o) + quadrature*sin(2*pi*o) + 0.5*(1 - cos(2*pi*o)),
+    without another oscillator.
+
+    Setting the frequency to 0 doesn't stop the LFO dead. It keeps running at
+    drainFrequency until the phase wraps back round to 0, then parks there. That
+    way the modulated delay settles at the centre of the sweep.
+*/
+class CombLfo
+{
+public:
+    static constexpr int controlInterval = 16, seedInterval = 256;
+    static constexpr double drainFrequency = 0.05;
+
+    //==============================================================================
+    void prepare (double newSampleRate) noexcept
+    {
+        setSampleRate (newSampleRate);
+        reset();
+    }
+
+    /** Changes the rate the LFO is rendered at without disturbing its phase. */
+    void setSampleRate (double newSampleRate) noexcept
+    {
+        const double currentFrequency = std::max (0.0, frequency);
+
+        sampleRate = newSampleRate;
+        frequency = -1.0;
+        setFrequency (currentFrequency);
+    }
+
+    void reset() noexcept                           { phase = 0; samplesUntilSeed = 0; }
+
+    void setFrequency (double newFrequency) noexcept
+    {
+        newFrequency = std::max (0.0, newFrequency);
+
+        if (newFrequency != frequency)
+        {
+            frequency = newFrequency;
+            runningRotation = Rotation (frequency/sampleRate);
+            drainRotation = Rotation (drainFrequency/sampleRate);
+            samplesUntilSeed = 0;
+        }
+    }
+
+    void setControlRate (bool shouldUseControlRate) noexcept   { controlRate = shouldUseControlRate; }
+    bool isControlRate() const noexcept                         { return controlRate; }
+
+    double getPhase() const noexcept                { return toCycles (phase); }
+    void setPhase (double newPhase) noexcept        { phase = toFixed (newPhase); samplesUntilSeed = 0; }
+
+    //==============================================================================
+    /** Writes the next numSamples LFO values to dest, and their quadrature
+        values to quadrature unless it is null, and advances the phase.
+    */
+    void render (float* dest, float* quadrature, int numSamples) noexcept
+    {
+        if (frequency > 0.0)
+        {
+            renderSegment (dest, quadrature, numSamples, runningRotation);
+            return;
+        }
+
+        // stopped: drain until the phase wraps, then hold it
+        int numDraining = 0;
+
+        if (phase > parkedPhase)
+            numDraining = samplesToWrap (numSamples);
+
+        renderSegment (dest, quadrature, numDraining, drainRotation);
+        std::fill (dest + numDraining, dest + numSamples, valueAt (phase));
+
+        if (quadrature != nullptr)
+            std::fill (quadrature + numDraining, quadrature + numSamples, (float) (0.5*std::cos (twoPi*toCycles (phase))));
+    }
+
+    void render (float* dest, int numSamples) noexcept     { render (dest, nullptr, numSamples); }
+
+    /** Advances the phase by numSamples as render() would, without rendering. */
+    void skip (int numSamples) noexcept
+    {
+        samplesUntilSeed = 0;
+
+        if (frequency > 0.0)
+        {
+            advance (numSamples, runningRotation);
+            return;
+        }
+
+        if (phase > parkedPhase)
+            advance (samplesToWrap (numSamples), drainRotation);
+    }
+
+private:
+    /** A per-sample phase increment, and the phasor rotations for it and for a
+        whole control interval. The rotations are worked out from the increment
+        after rounding, so the oscillator turns at exactly the rate the phase does.
+    */
+    struct Rotation
+    {
+        Rotation() = default;
+
+        explicit Rotation (double cyclesPerSample) noexcept
+            : increment (toFixed (cyclesPerSample)),
+              cosStep (std::cos (twoPi*toCycles (increment))), sinStep (std::sin (twoPi*toCycles (increment))),
+              cosInterval (std::cos (twoPi*toCycles (increment*controlInterval))), sinInterval (std::sin (twoPi*toCycles (increment*controlInterval)))
+        {}
+
+        std::uint64_t increment = 0;
+        double cosStep = 1.0, sinStep = 0.0, cosInterval = 1.0, sinInterval = 0.0;
+    };
+
+    /** Converts between cycles and the fixed-point phase, wrapping into [0, 1). */
+    static std::uint64_t toFixed (double cycles) noexcept
+    {
+        const double fraction = cycles - std::floor (cycles);
+
+        // scaling by a power of two is exact, and a fraction a hair below 1 can
+        // still round up to it
+        return fraction < 1.0 ? (std::uint64_t) (fraction*fixedOne) : 0;
+    }
+
+    static double toCycles (std::uint64_t fixedPhase) noexcept  { return (double) fixedPhase/fixedOne; }
+
+    static float valueAt (std::uint64_t p) noexcept     { return (float) (0.5 + 0.5*std::sin (twoPi*toCycles (p))); }
+
+    /** How many of the next numSamples the drain takes to wrap the phase round to 0. */
+    int samplesToWrap (int numSamples) const noexcept
+    {
+        if (drainRotation.increment == 0)
+            return 0;
+
+        // the distance left to go is the phase's two's complement
+        const std::uint64_t remaining = 0 - phase;
+        return (int) std::min ((std::uint64_t) numSamples, remaining/drainRotation.increment + (remaining%drainRotation.increment != 0));
+    }
+
+    void renderSegment (float* dest, float* quadrature, int numSamples, const Rotation& rotation) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        if (controlRate)
+        {
+            const double seed = twoPi*toCycles (phase);
+            double c = std::cos (seed), s = std::sin (seed);
+
+            for (int i = 0; i < numSamples; i += controlInterval)
+            {
+                const double cNext = c*rotation.cosInterval - s*rotation.sinInterval;
+                const double sNext = s*rotation.cosInterval + c*rotation.sinInterval;
+                const float start = (float) (0.5 + 0.5*s);
+                const float step = (float) (0.5*(sNext - s))/(float) controlInterval;
+                const int end = std::min (controlInterval, numSamples - i);
+
+                for (int j = 0; j < end; ++j)
+                    dest[i + j] = start + step*(float) j;
+
+                if (quadrature != nullptr)
+                {
+                    const float quadratureStart = (float) (0.5*c);
+                    const float quadratureStep = (float) (0.5*(cNext - c))/(float) controlInterval;
+
+                    for (int j = 0; j < end; ++j)
+                        quadrature[i + j] = quadratureStart + quadratureStep*(float) j;
+                }
+
+                c = cNext;
+                s = sNext;
+            }
+
+            advance (numSamples, rotation);
+            samplesUntilSeed = 0;
+            return;
+        }
+
+        for (int start = 0; start < numSamples;)
+        {
+            if (samplesUntilSeed == 0)
+            {
+                const double seed = twoPi*toCycles (phase);
+                phasorCos = std::cos (seed);
+                phasorSin = std::sin (seed);
+                samplesUntilSeed = seedInterval;
+            }
+
+            const int end = std::min (numSamples, start + samplesUntilSeed);
+            double c = phasorCos, s = phasorSin;
+
+            for (int i = start; i < end; ++i)
+            {
+                dest[i] = (float) (0.5 + 0.5*s);
+
+                if (quadrature != nullptr)
+                    quadrature[i] = (float) (0.5*c);
+
+                const double cNext = c*rotation.cosStep - s*rotation.sinStep;
+                s = s*rotation.cosStep + c*rotation.sinStep;
+                c = cNext;
+            }
+
+            phasorCos = c;
+            phasorSin = s;
+            advance (end - start, rotation);
+            samplesUntilSeed -= end - start;
+            start = end;
+        }
+    }
+
+    void advance (int numSamples, const Rotation& rotation) noexcept
+    {
+        // wraps round by overflowing
+        phase += rotation.increment*(std::uint64_t) numSamples;
+    }
+
+    static constexpr double twoPi = 6.283185307179586;
+    static constexpr double fixedOne = 18446744073709551616.0;     // 2^64, one whole cycle
+    static constexpr std::uint64_t parkedPhase = (std::uint64_t) (0.01*fixedOne);
+
+    double sampleRate = 44100.0, frequency = 0.0;
+    std::uint64_t phase = 0;
+
+    // the running phasor, and how many more samples it runs before the next seed
+    double phasorCos = 1.0, phasorSin = 0.0;
+    int samplesUntilSeed = 0;
+    Rotation runningRotation, drainRotation;
+    bool controlRate = false;
+};
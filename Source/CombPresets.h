@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    CombPresets.h
+
+    The factory program bank, shared by the plugin and the command line tools.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstring>
+
+#include "CombEngine.h"
+
+//==============================================================================
+/**
+    One of the effects described in the README. A preset only covers the
+    effect itself; quality settings (interpolation, oversampling and maximum
+    delay) and the voices are left as they are.
+*/
+struct CombPreset
+{
+    const char* id;         // short name for the command line
+    const char* name;
+    float feedforward, feedback, bleed, delay, sweepWidth, lfoFreq;
+    bool tremolo;
+
+    void applyTo (CombParameters& params) const noexcept
+    {
+        params.feedforward = feedforward;
+        params.feedback = feedback;
+        params.bleed = bleed;
+        params.delay = delay;
+        params.sweepWidth = sweepWidth;
+        params.lfoFreq = lfoFreq;
+        params.tremolo = tremolo;
+    }
+};
+
+static constexpr CombPreset combPresets[] =
+{
+    //  id          name          ff    fb    bl    delay  depth   freq
+    { "flanger",  "Flanger",   0.7f, 0.7f, 0.7f, 0.0f,  0.002f, 0.5f,   false },
+    { "vibrato",  "Vibrato",   1.0f, 0.0f, 0.0f, 0.0f,  0.002f, 4.0f,   false },
+    { "ringmod",  "Ring Mod",  1.0f, 0.0f, 0.0f, 0.0f,  0.005f, 100.0f, false },
+    { "chorus",   "Chorus",    1.0f, 0.0f, 1.0f, 0.02f, 0.0f,   0.0f,   false },
+    { "echo",     "Echo",      1.0f, 0.5f, 1.0f, 0.3f,  0.0f,   0.0f,   false },
+};
+
+static constexpr int numCombPresets = (int) (sizeof (combPresets)/sizeof (combPresets[0]));
+
+/** Returns the preset with the given id, or nullptr. */
+inline const CombPreset* findCombPreset (const char* id) noexcept
+{
+    for (auto& preset : combPresets)
+        if (std::strcmp (id, preset.id) == 0)
+            return &preset;
+
+    return nullptr;
+}
+
+/** Sets the effect parameters of dest (those a preset covers) to a point
+    amount of the way from one set to another, for morphing between presets.
+    Tremolo is switched as soon as the morph starts.
+*/
+inline void morphCombParameters (CombParameters& dest, const CombParameters& from, const CombParameters& to, float amount) noexcept
+{
+    const auto mix = [amount] (float a, float b) { return a + amount*(b - a); };
+
+    dest.feedforward = mix (from.feedforward, to.feedforward);
+    dest.feedback = mix (from.feedback, to.feedback);
+    dest.bleed = mix (from.bleed, to.bleed);
+    dest.delay = mix (from.delay, to.delay);
+    dest.sweepWidth = mix (from.sweepWidth, to.sweepWidth);
+    dest.lfoFreq = mix (from.lfoFreq, to.lfoFreq);
+    dest.tremolo = amount > 0.0f ? to.tremolo : from.tremolo;
+}
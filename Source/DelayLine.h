@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    DelayLine.h
+
+    Power-of-two circular buffer used by CombEngine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/**
+    A circular buffer of frames whose capacity is rounded up to a power of two,
+    so indices wrap with a bitmask instead of % or fmodf. Each frame holds one
+    sample per lane, stored interleaved, so every channel's tap at a given delay
+    is in the same place in memory.
+
+    The first guardSize frames are mirrored past the end of the buffer, which
+    means up to guardSize + 1 consecutive frames starting from any wrapped index
+    can be read straight from getReadPointer() without wrapping again. That keeps
+    multi-tap interpolation reads contiguous.
+
+    The frames start on an alignment-byte boundary within the one allocation.
+    With a whole number of SimdVectors per frame, no vector load or store then
+    straddles two cache lines. The guard frames have to follow the buffer
+    contiguously, so both live in one std::vector, padded by up to a boundary's
+    worth of samples, rather than in a separately aligned block.
+*/
+template <typename SampleType>
+class DelayLine
+{
+public:
+    static constexpr int guardSize = 8;
+
+    /** Bytes the first frame is aligned to: a cache line, and the widest vector register. */
+    static constexpr int alignment = 64;
+
+    DelayLine() = default;
+    DelayLine (const DelayLine&) = delete;
+    DelayLine& operator= (const DelayLine&) = delete;
+
+    /** Resizes the buffer to hold at least minimumCapacity frames of numLanes
+        samples each, and clears it. The storage is only reallocated if it has to
+        grow; a smaller size reuses what is already there.
+    */
+    void setSize (int newNumLanes, int minimumCapacity)
+    {
+        numLanes = std::max (1, newNumLanes);
+        capacity = 1;
+        while (capacity < minimumCapacity)
+            capacity <<= 1;
+
+        mask = capacity - 1;
+
+        // room to move the first frame up to the next boundary. The allocation is
+        // at least aligned to a SampleType, so that is a whole number of samples
+        constexpr int padding = alignment/(int) sizeof (SampleType) - 1;
+        data.assign ((size_t) ((capacity + guardSize)*numLanes + padding), SampleType());
+
+        const auto address = reinterpret_cast<std::uintptr_t> (data.data());
+        frames = data.data() + (alignment - address % alignment) % alignment/sizeof (SampleType);
+    }
+
+    /** Frees the storage, leaving an empty single-frame buffer. */
+    void freeStorage()
+    {
+        std::vector<SampleType>().swap (data);
+        capacity = 1;
+        mask = 0;
+        frames = nullptr;
+    }
+
+    /** Exchanges the contents of two buffers without copying or allocating. */
+    void swapWith (DelayLine& other) noexcept
+    {
+        data.swap (other.data);
+        std::swap (numLanes, other.numLanes);
+        std::swap (capacity, other.capacity);
+        std::swap (mask, other.mask);
+        std::swap (frames, other.frames);
+    }
+
+    /** Copies numFrames consecutive frames of another buffer with the same number
+        of lanes, from an already wrapped index there to one here, wrapping round
+        the end of both. numFrames must not exceed either capacity.
+    */
+    void copyFramesFrom (const DelayLine& source, int sourceIndex, int index, int numFrames) noexcept
+    {
+        const int numBeforeEnd = std::min (numFrames, source.capacity - sourceIndex);
+
+        writeFrames (index, source.getReadPointer (sourceIndex), numBeforeEnd);
+        writeFrames (wrap (index + numBeforeEnd), source.getReadPointer (0), numFrames - numBeforeEnd);
+    }
+
+    void clear() noexcept                   { std::fill (data.begin(), data.end(), SampleType()); }
+
+    int getNumLanes() const noexcept        { return numLanes; }
+    int getCapacity() const noexcept        { return capacity; }
+    int getMask() const noexcept            { return mask; }
+
+    /** Wraps any index, including negative ones, into the buffer. */
+    int wrap (int index) const noexcept     { return index & mask; }
+
+    /** Returns the frame at a wrapped index, followed by at least guardSize further
+        frames in delay-line order.
+    */
+    const SampleType* getReadPointer (int index) const noexcept     { return frames + index*numLanes; }
+
+    /** Returns the frame at a wrapped index for writing. Anything written there must
+        also be written to getMirrorPointer() for the same index.
+    */
+    SampleType* getWritePointer (int index) noexcept                { return frames + index*numLanes; }
+
+    /** Returns the guard copy of a frame if it has one, or the frame itself if not. */
+    SampleType* getMirrorPointer (int index) noexcept               { return frames + (index + (index < guardSize ? capacity : 0))*numLanes; }
+
+    /** Copies numFrames consecutive frames into the buffer starting at an already
+        wrapped index, wrapping round the end and keeping the guard region in sync.
+        numFrames must not exceed the capacity.
+    */
+    void writeFrames (int index, const SampleType* src, int numFrames) noexcept
+    {
+        const int numBeforeEnd = std::min (numFrames, capacity - index);
+
+        std::copy (src, src + numBeforeEnd*numLanes, getWritePointer (index));
+        std::copy (src + numBeforeEnd*numLanes, src + numFrames*numLanes, getWritePointer (0));
+
+        if (index < guardSize || numFrames > numBeforeEnd)
+            std::copy (getReadPointer (0), getReadPointer (guardSize), getWritePointer (capacity));
+    }
+
+    /** Copies numFrames consecutive frames out of the buffer starting at an already
+        wrapped index, wrapping round the end. numFrames must not exceed the capacity.
+    */
+    void readFrames (int index, SampleType* dest, int numFrames) const noexcept
+    {
+        const int numBeforeEnd = std::min (numFrames, capacity - index);
+
+        std::copy (getReadPointer (index), getReadPointer (index + numBeforeEnd), dest);
+        std::copy (getReadPointer (0), getReadPointer (numFrames - numBeforeEnd), dest + numBeforeEnd*numLanes);
+    }
+
+    /** Zeroes numFrames consecutive frames starting at an already wrapped index,
+        wrapping round the end and keeping the guard region in sync. numFrames
+        must not exceed the capacity.
+    */
+    void clearFrames (int index, int numFrames) noexcept
+    {
+        const int numBeforeEnd = std::min (numFrames, capacity - index);
+
+        std::fill (getWritePointer (index), getWritePointer (index + numBeforeEnd), SampleType());
+        std::fill (getWritePointer (0), getWritePointer (numFrames - numBeforeEnd), SampleType());
+
+        if (index < guardSize || numFrames > numBeforeEnd)
+            std::copy (getReadPointer (0), getReadPointer (guardSize), getWritePointer (capacity));
+    }
+
+    /** Writes a single-lane sample at an already wrapped index, keeping the guard region in sync. */
+    void write (int index, SampleType value) noexcept
+    {
+        *getWritePointer (index) = value;
+        *getMirrorPointer (index) = value;
+    }
+
+private:
+    std::vector<SampleType> data;
+    SampleType* frames = nullptr;     // the first frame, within data
+    int numLanes = 1, capacity = 1, mask = 0;
+};
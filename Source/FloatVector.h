@@ -0,0 +1,251 @@
+/*
+  ==============================================================================
+
+    FloatVector.h
+
+    Minimal 4-lane float and double vectors used by the CombEngine lane kernels.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <utility>
+
+#if defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define COMB_FLOATVECTOR_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__) || defined (_M_ARM64)
+ #include <arm_neon.h>
+ #define COMB_FLOATVECTOR_NEON 1
+ #if defined (__aarch64__) || defined (_M_ARM64)
+  #define COMB_FLOATVECTOR_NEON64 1
+ #endif
+#endif
+
+//==============================================================================
+/**
+    Four samples processed together, using SSE or NEON where available and plain
+    arrays (which the compiler is free to vectorise) otherwise. Only the handful
+    of operations the comb kernels need are provided. Loads and stores don't
+    need to be aligned.
+
+    The lane count is four for both sample types, so a kernel's frame layout
+    doesn't depend on its precision. A double vector is made of two registers.
+    There are no 2- or 8-lane widths: a frame holds one lane per channel, so
+    mono, stereo and quad each take one vector, and 5.1 or 7.1 frames take
+    two, which the engine unrolls (its NumVectors paths).
+
+    transpose() treats four vectors as the rows of a 4x4 matrix, which is how
+    four channels are moved in and out of interleaved frames together.
+
+    gather() loads each lane from its own offset from src, for kernels whose
+    lanes read at different delays.
+
+    getSum() adds the lanes as (0 + 2) + (1 + 3) in every implementation, so a
+    sum comes out the same whichever instruction set computes it.
+*/
+template <typename SampleType>
+struct SimdVector
+{
+    static constexpr int size = 4;
+
+    SampleType value[size];
+
+    static SimdVector load (const SampleType* src) noexcept             { return { { src[0], src[1], src[2], src[3] } }; }
+    static SimdVector broadcast (SampleType x) noexcept                 { return { { x, x, x, x } }; }
+    static SimdVector gather (const SampleType* src, const int* offsets) noexcept   { return { { src[offsets[0]], src[offsets[1]], src[offsets[2]], src[offsets[3]] } }; }
+    void store (SampleType* dest) const noexcept                        { for (int i = 0; i < size; ++i) dest[i] = value[i]; }
+
+    friend SimdVector operator+ (SimdVector a, SimdVector b) noexcept   { for (int i = 0; i < size; ++i) a.value[i] += b.value[i]; return a; }
+    friend SimdVector operator- (SimdVector a, SimdVector b) noexcept   { for (int i = 0; i < size; ++i) a.value[i] -= b.value[i]; return a; }
+    friend SimdVector operator* (SimdVector a, SimdVector b) noexcept   { for (int i = 0; i < size; ++i) a.value[i] *= b.value[i]; return a; }
+
+    static SimdVector max (SimdVector a, SimdVector b) noexcept         { for (int i = 0; i < size; ++i) a.value[i] = a.value[i] < b.value[i] ? b.value[i] : a.value[i]; return a; }
+    SimdVector abs() const noexcept                                     { auto r = *this; for (int i = 0; i < size; ++i) r.value[i] = r.value[i] < 0 ? -r.value[i] : r.value[i]; return r; }
+    SampleType getMax() const noexcept                                  { auto m = value[0]; for (int i = 1; i < size; ++i) m = m < value[i] ? value[i] : m; return m; }
+    SampleType getSum() const noexcept                                  { return (value[0] + value[2]) + (value[1] + value[3]); }
+
+    static void transpose (SimdVector& a, SimdVector& b, SimdVector& c, SimdVector& d) noexcept
+    {
+        SimdVector* rows[] = { &a, &b, &c, &d };
+
+        for (int i = 0; i < size; ++i)
+            for (int j = i + 1; j < size; ++j)
+                std::swap (rows[i]->value[j], rows[j]->value[i]);
+    }
+};
+
+#if COMB_FLOATVECTOR_SSE
+template <>
+struct SimdVector<float>
+{
+    static constexpr int size = 4;
+
+    __m128 value;
+
+    static SimdVector load (const float* src) noexcept                  { return { _mm_loadu_ps (src) }; }
+    static SimdVector broadcast (float x) noexcept                      { return { _mm_set1_ps (x) }; }
+    static SimdVector gather (const float* src, const int* offsets) noexcept    { return { _mm_setr_ps (src[offsets[0]], src[offsets[1]], src[offsets[2]], src[offsets[3]]) }; }
+    void store (float* dest) const noexcept                             { _mm_storeu_ps (dest, value); }
+
+    friend SimdVector operator+ (SimdVector a, SimdVector b) noexcept   { return { _mm_add_ps (a.value, b.value) }; }
+    friend SimdVector operator- (SimdVector a, SimdVector b) noexcept   { return { _mm_sub_ps (a.value, b.value) }; }
+    friend SimdVector operator* (SimdVector a, SimdVector b) noexcept   { return { _mm_mul_ps (a.value, b.value) }; }
+
+    static SimdVector max (SimdVector a, SimdVector b) noexcept         { return { _mm_max_ps (a.value, b.value) }; }
+    SimdVector abs() const noexcept                                     { return { _mm_andnot_ps (_mm_set1_ps (-0.0f), value) }; }
+
+    float getMax() const noexcept
+    {
+        const auto m = _mm_max_ps (value, _mm_shuffle_ps (value, value, _MM_SHUFFLE (1, 0, 3, 2)));
+        return _mm_cvtss_f32 (_mm_max_ss (m, _mm_shuffle_ps (m, m, _MM_SHUFFLE (2, 3, 0, 1))));
+    }
+
+    float getSum() const noexcept
+    {
+        const auto s = _mm_add_ps (value, _mm_shuffle_ps (value, value, _MM_SHUFFLE (1, 0, 3, 2)));
+        return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, _MM_SHUFFLE (2, 3, 0, 1))));
+    }
+
+    static void transpose (SimdVector& a, SimdVector& b, SimdVector& c, SimdVector& d) noexcept
+    {
+        _MM_TRANSPOSE4_PS (a.value, b.value, c.value, d.value);
+    }
+};
+
+template <>
+struct SimdVector<double>
+{
+    static constexpr int size = 4;
+
+    __m128d low, high;
+
+    static SimdVector load (const double* src) noexcept                 { return { _mm_loadu_pd (src), _mm_loadu_pd (src + 2) }; }
+    static SimdVector broadcast (double x) noexcept                     { return { _mm_set1_pd (x), _mm_set1_pd (x) }; }
+    static SimdVector gather (const double* src, const int* offsets) noexcept   { return { _mm_setr_pd (src[offsets[0]], src[offsets[1]]), _mm_setr_pd (src[offsets[2]], src[offsets[3]]) }; }
+    void store (double* dest) const noexcept                            { _mm_storeu_pd (dest, low); _mm_storeu_pd (dest + 2, high); }
+
+    friend SimdVector operator+ (SimdVector a, SimdVector b) noexcept   { return { _mm_add_pd (a.low, b.low), _mm_add_pd (a.high, b.high) }; }
+    friend SimdVector operator- (SimdVector a, SimdVector b) noexcept   { return { _mm_sub_pd (a.low, b.low), _mm_sub_pd (a.high, b.high) }; }
+    friend SimdVector operator* (SimdVector a, SimdVector b) noexcept   { return { _mm_mul_pd (a.low, b.low), _mm_mul_pd (a.high, b.high) }; }
+
+    static SimdVector max (SimdVector a, SimdVector b) noexcept         { return { _mm_max_pd (a.low, b.low), _mm_max_pd (a.high, b.high) }; }
+    SimdVector abs() const noexcept                                     { const auto sign = _mm_set1_pd (-0.0); return { _mm_andnot_pd (sign, low), _mm_andnot_pd (sign, high) }; }
+
+    double getMax() const noexcept
+    {
+        const auto m = _mm_max_pd (low, high);
+        return _mm_cvtsd_f64 (_mm_max_sd (m, _mm_unpackhi_pd (m, m)));
+    }
+
+    double getSum() const noexcept
+    {
+        const auto s = _mm_add_pd (low, high);
+        return _mm_cvtsd_f64 (_mm_add_sd (s, _mm_unpackhi_pd (s, s)));
+    }
+
+    static void transpose (SimdVector& a, SimdVector& b, SimdVector& c, SimdVector& d) noexcept
+    {
+        const SimdVector rows[] = { a, b, c, d };
+
+        a = { _mm_unpacklo_pd (rows[0].low, rows[1].low),   _mm_unpacklo_pd (rows[2].low, rows[3].low) };
+        b = { _mm_unpackhi_pd (rows[0].low, rows[1].low),   _mm_unpackhi_pd (rows[2].low, rows[3].low) };
+        c = { _mm_unpacklo_pd (rows[0].high, rows[1].high), _mm_unpacklo_pd (rows[2].high, rows[3].high) };
+        d = { _mm_unpackhi_pd (rows[0].high, rows[1].high), _mm_unpackhi_pd (rows[2].high, rows[3].high) };
+    }
+};
+#elif COMB_FLOATVECTOR_NEON
+template <>
+struct SimdVector<float>
+{
+    static constexpr int size = 4;
+
+    float32x4_t value;
+
+    static SimdVector load (const float* src) noexcept                  { return { vld1q_f32 (src) }; }
+    static SimdVector broadcast (float x) noexcept                      { return { vdupq_n_f32 (x) }; }
+
+    static SimdVector gather (const float* src, const int* offsets) noexcept
+    {
+        auto v = vld1q_dup_f32 (src + offsets[0]);
+        v = vld1q_lane_f32 (src + offsets[1], v, 1);
+        v = vld1q_lane_f32 (src + offsets[2], v, 2);
+        return { vld1q_lane_f32 (src + offsets[3], v, 3) };
+    }
+
+    void store (float* dest) const noexcept                             { vst1q_f32 (dest, value); }
+
+    friend SimdVector operator+ (SimdVector a, SimdVector b) noexcept   { return { vaddq_f32 (a.value, b.value) }; }
+    friend SimdVector operator- (SimdVector a, SimdVector b) noexcept   { return { vsubq_f32 (a.value, b.value) }; }
+    friend SimdVector operator* (SimdVector a, SimdVector b) noexcept   { return { vmulq_f32 (a.value, b.value) }; }
+
+    static SimdVector max (SimdVector a, SimdVector b) noexcept         { return { vmaxq_f32 (a.value, b.value) }; }
+    SimdVector abs() const noexcept                                     { return { vabsq_f32 (value) }; }
+
+    float getMax() const noexcept
+    {
+        const auto m = vpmax_f32 (vget_low_f32 (value), vget_high_f32 (value));
+        return vget_lane_f32 (vpmax_f32 (m, m), 0);
+    }
+
+    float getSum() const noexcept
+    {
+        const auto s = vadd_f32 (vget_low_f32 (value), vget_high_f32 (value));
+        return vget_lane_f32 (vpadd_f32 (s, s), 0);
+    }
+
+    static void transpose (SimdVector& a, SimdVector& b, SimdVector& c, SimdVector& d) noexcept
+    {
+        const auto ab = vtrnq_f32 (a.value, b.value);
+        const auto cd = vtrnq_f32 (c.value, d.value);
+        a.value = vcombine_f32 (vget_low_f32 (ab.val[0]), vget_low_f32 (cd.val[0]));
+        b.value = vcombine_f32 (vget_low_f32 (ab.val[1]), vget_low_f32 (cd.val[1]));
+        c.value = vcombine_f32 (vget_high_f32 (ab.val[0]), vget_high_f32 (cd.val[0]));
+        d.value = vcombine_f32 (vget_high_f32 (ab.val[1]), vget_high_f32 (cd.val[1]));
+    }
+};
+
+ #if COMB_FLOATVECTOR_NEON64
+template <>
+struct SimdVector<double>
+{
+    static constexpr int size = 4;
+
+    float64x2_t low, high;
+
+    static SimdVector load (const double* src) noexcept                 { return { vld1q_f64 (src), vld1q_f64 (src + 2) }; }
+    static SimdVector broadcast (double x) noexcept                     { return { vdupq_n_f64 (x), vdupq_n_f64 (x) }; }
+
+    static SimdVector gather (const double* src, const int* offsets) noexcept
+    {
+        return { vld1q_lane_f64 (src + offsets[1], vld1q_dup_f64 (src + offsets[0]), 1),
+                 vld1q_lane_f64 (src + offsets[3], vld1q_dup_f64 (src + offsets[2]), 1) };
+    }
+
+    void store (double* dest) const noexcept                            { vst1q_f64 (dest, low); vst1q_f64 (dest + 2, high); }
+
+    friend SimdVector operator+ (SimdVector a, SimdVector b) noexcept   { return { vaddq_f64 (a.low, b.low), vaddq_f64 (a.high, b.high) }; }
+    friend SimdVector operator- (SimdVector a, SimdVector b) noexcept   { return { vsubq_f64 (a.low, b.low), vsubq_f64 (a.high, b.high) }; }
+    friend SimdVector operator* (SimdVector a, SimdVector b) noexcept   { return { vmulq_f64 (a.low, b.low), vmulq_f64 (a.high, b.high) }; }
+
+    static SimdVector max (SimdVector a, SimdVector b) noexcept         { return { vmaxq_f64 (a.low, b.low), vmaxq_f64 (a.high, b.high) }; }
+    SimdVector abs() const noexcept                                     { return { vabsq_f64 (low), vabsq_f64 (high) }; }
+    double getMax() const noexcept                                      { return vmaxvq_f64 (vmaxq_f64 (low, high)); }
+    double getSum() const noexcept                                      { return vaddvq_f64 (vaddq_f64 (low, high)); }
+
+    static void transpose (SimdVector& a, SimdVector& b, SimdVector& c, SimdVector& d) noexcept
+    {
+        const SimdVector rows[] = { a, b, c, d };
+
+        a = { vzip1q_f64 (rows[0].low, rows[1].low),   vzip1q_f64 (rows[2].low, rows[3].low) };
+        b = { vzip2q_f64 (rows[0].low, rows[1].low),   vzip2q_f64 (rows[2].low, rows[3].low) };
+        c = { vzip1q_f64 (rows[0].high, rows[1].high), vzip1q_f64 (rows[2].high, rows[3].high) };
+        d = { vzip2q_f64 (rows[0].high, rows[1].high), vzip2q_f64 (rows[2].high, rows[3].high) };
+    }
+};
+ #endif
+#endif
+
+using FloatVector = SimdVector<float>;
+using DoubleVector = SimdVector<double>;
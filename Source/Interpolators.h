@@ -0,0 +1,323 @@
+/*
+  ==============================================================================
+
+    Interpolators.h
+
+    Fractional delay interpolation kernels for CombEngine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "FloatVector.h"
+
+//==============================================================================
+/** The interpolation kernels the engine can read its delay line with. */
+enum class InterpolationQuality
+{
+    linear,     // 2 taps, cheapest
+    cubic,      // 4-tap Lagrange, from a polyphase table
+    allpass,    // 1st-order Thiran allpass, flat magnitude response
+    sinc,       // 8-tap Kaiser-windowed sinc, from an interpolated polyphase table
+    numQualities
+};
+
+//==============================================================================
+/**
+    Fractional delay FIR coefficients tabulated over numPhases + 1 evenly spaced
+    fractional delays from 0 to 1 inclusive. Row k holds the numTaps weights,
+    oldest tap first, for a delay of k/numPhases samples beyond the newest tap
+    that isn't newer than the read position.
+*/
+struct PolyphaseTable
+{
+    int numTaps = 0, numPhases = 0;
+    std::vector<float> coefficients;
+
+    const float* getRow (int phase) const noexcept  { return coefficients.data() + phase*numTaps; }
+
+    /** Builds a table from weightFn (tapDelay, fractionalDelay), where tapDelay is
+        the tap's delay in samples relative to the read position's integer part.
+        Each row is normalised to unity gain at DC and scaled down if its
+        magnitude response exceeds 1 anywhere, so a feedback gain of 1 stays stable.
+    */
+    template <typename WeightFn>
+    static PolyphaseTable build (int numTaps, int numNewerTaps, int numPhases, WeightFn&& weightFn)
+    {
+        PolyphaseTable table;
+        table.numTaps = numTaps;
+        table.numPhases = numPhases;
+        table.coefficients.resize ((size_t) ((numPhases + 1)*numTaps));
+
+        std::vector<double> row ((size_t) numTaps);
+
+        for (int phase = 0; phase <= numPhases; ++phase)
+        {
+            const double delay = (double) phase/numPhases;
+            double sum = 0.0;
+
+            for (int j = 0; j < numTaps; ++j)
+            {
+                row[(size_t) j] = weightFn ((double) (numTaps - 1 - numNewerTaps - j), delay);
+                sum += row[(size_t) j];
+            }
+
+            double maxGain = 0.0;
+
+            for (int bin = 0; bin <= 256; ++bin)
+            {
+                const double w = 3.141592653589793*bin/256.0;
+                double re = 0.0, im = 0.0;
+
+                for (int j = 0; j < numTaps; ++j)
+                {
+                    re += row[(size_t) j]/sum*std::cos (w*j);
+                    im -= row[(size_t) j]/sum*std::sin (w*j);
+                }
+
+                maxGain = std::max (maxGain, std::sqrt (re*re + im*im));
+            }
+
+            const double scale = 1.0/(sum*std::max (1.0, maxGain));
+
+            for (int j = 0; j < numTaps; ++j)
+                table.coefficients[(size_t) (phase*numTaps + j)] = (float) (row[(size_t) j]*scale);
+        }
+
+        return table;
+    }
+};
+
+/** The precomputed tables used by the table-driven interpolators.
+
+    They're the same for every sample rate and never change once built, so a
+    process running many engines (a host with a hundred plugin instances, say)
+    only needs one copy: getShared() hands out that copy.
+*/
+struct InterpolationTables
+{
+    static constexpr int numPhases = 1024;
+
+    PolyphaseTable cubic, sinc;
+
+    /** Returns the process-wide tables, building them if nobody holds them yet.
+        They're freed again when the last pointer to them goes. Building takes a
+        few milliseconds and a lock, so call this while preparing, never from
+        the audio thread.
+    */
+    static std::shared_ptr<const InterpolationTables> getShared()
+    {
+        static std::mutex lock;
+        static std::weak_ptr<const InterpolationTables> shared;
+
+        // anyone else asking meanwhile waits for the one copy rather than building their own
+        const std::lock_guard<std::mutex> guard (lock);
+        auto tables = shared.lock();
+
+        if (tables == nullptr)
+        {
+            tables = std::make_shared<const InterpolationTables>();
+            shared = tables;
+        }
+
+        return tables;
+    }
+
+    InterpolationTables()
+    {
+        cubic = PolyphaseTable::build (4, 1, numPhases, [] (double tapDelay, double delay)
+        {
+            // Lagrange basis polynomial for the tap at tapDelay, over taps at 2, 1, 0, -1
+            double w = 1.0;
+
+            for (int k = -1; k <= 2; ++k)
+                if (k != (int) tapDelay)
+                    w *= (delay - k)/(tapDelay - k);
+
+            return w;
+        });
+
+        sinc = PolyphaseTable::build (8, 3, numPhases, [] (double tapDelay, double delay)
+        {
+            return windowedSinc (delay - tapDelay, 0.9, 4.0);
+        });
+    }
+
+    /** The sinc kernels' weight for a tap x samples from the read position: a
+        lowpass at cutoff (1 being the Nyquist frequency) under a Kaiser window
+        reaching zero halfLength samples either side. Not normalised.
+    */
+    static double windowedSinc (double x, double cutoff, double halfLength) noexcept
+    {
+        constexpr double beta = 7.0, pi = 3.141592653589793;
+        const double r = x/halfLength;
+
+        if (std::abs (r) >= 1.0)
+            return 0.0;
+
+        const double value = x == 0.0 ? 1.0 : std::sin (pi*cutoff*x)/(pi*cutoff*x);
+        return value*besselI0 (beta*std::sqrt (1.0 - r*r))/besselI0 (beta);
+    }
+
+private:
+    static double besselI0 (double x) noexcept
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x/(2.0*k))*(x/(2.0*k));
+            sum += term;
+        }
+
+        return sum;
+    }
+};
+
+//==============================================================================
+/*
+    Each interpolator reads numTaps consecutive frames, oldest first. The newest
+    numNewerTaps of those are newer than the read position, so the delay must be
+    long enough for them to have been written already.
+
+    setDelay() is given the fractional part of the delay, beyond the newest tap
+    that isn't newer than the read position, once per frame. The read position
+    is the delay plus positionOffset. interpolate() then
+    runs once per SimdVector of lanes in that frame. state holds one sample per
+    lane for interpolators that need it.
+
+    Each is templated on the sample type of the delay line. The fraction and the
+    tables stay in float either way.
+*/
+
+/** Two-point linear interpolation. */
+template <typename SampleType>
+struct LinearInterpolator
+{
+    using Vector = SimdVector<SampleType>;
+    static constexpr int numTaps = 2, numNewerTaps = 0;
+    static constexpr float positionOffset = 0.0f;
+
+    explicit LinearInterpolator (const InterpolationTables&) noexcept {}
+
+    void setDelay (float fraction) noexcept     { frac = Vector::broadcast ((SampleType) fraction); }
+
+    Vector interpolate (const SampleType* taps, int stride, SampleType*) const noexcept
+    {
+        const auto older = Vector::load (taps);
+        const auto newer = Vector::load (taps + stride);
+        return newer + frac*(older - newer);
+    }
+
+    Vector frac = Vector::broadcast (0);
+};
+
+/** Four-point (cubic) Lagrange interpolation from the nearest table phase. */
+template <typename SampleType>
+struct CubicInterpolator
+{
+    using Vector = SimdVector<SampleType>;
+    static constexpr int numTaps = 4, numNewerTaps = 1;
+    static constexpr float positionOffset = 0.0f;
+
+    explicit CubicInterpolator (const InterpolationTables& tables) noexcept  : table (tables.cubic) {}
+
+    void setDelay (float fraction) noexcept
+    {
+        const float* row = table.getRow ((int) (fraction*(float) table.numPhases + 0.5f));
+
+        for (int j = 0; j < numTaps; ++j)
+            weights[j] = Vector::broadcast ((SampleType) row[j]);
+    }
+
+    Vector interpolate (const SampleType* taps, int stride, SampleType*) const noexcept
+    {
+        auto sum = weights[0]*Vector::load (taps);
+
+        for (int j = 1; j < numTaps; ++j)
+            sum = sum + weights[j]*Vector::load (taps + j*stride);
+
+        return sum;
+    }
+
+    const PolyphaseTable& table;
+    Vector weights[numTaps];
+};
+
+/** First-order Thiran allpass. The filter's own delay d is kept between 0.5
+    and 1.5 samples, centred on the one sample where it is exact, so read
+    positions are moved half a sample further back (positionOffset) before
+    they are split, and d is half a sample plus the fraction. In that range
+    the coefficient stays within -1/5 to 1/3, and its phase delay is accurate
+    further up the spectrum than between 1 and 2. The coefficient still steps
+    where a position crosses a half sample and the taps move on by one.
+*/
+template <typename SampleType>
+struct AllpassInterpolator
+{
+    using Vector = SimdVector<SampleType>;
+    static constexpr int numTaps = 2, numNewerTaps = 1;
+    static constexpr float positionOffset = 0.5f;
+
+    explicit AllpassInterpolator (const InterpolationTables&) noexcept {}
+
+    void setDelay (float fraction) noexcept
+    {
+        const SampleType d = (SampleType) 0.5 + (SampleType) fraction;
+        coefficient = Vector::broadcast ((1 - d)/(1 + d));
+    }
+
+    Vector interpolate (const SampleType* taps, int stride, SampleType* state) const noexcept
+    {
+        // y[n] = a*x[n] + x[n-1] - a*y[n-1]
+        const auto previous = Vector::load (state);
+        const auto y = Vector::load (taps) + coefficient*(Vector::load (taps + stride) - previous);
+        y.store (state);
+        return y;
+    }
+
+    Vector coefficient = Vector::broadcast (0);
+};
+
+/** Eight-point windowed sinc, interpolating between adjacent table phases. */
+template <typename SampleType>
+struct SincInterpolator
+{
+    using Vector = SimdVector<SampleType>;
+    static constexpr int numTaps = 8, numNewerTaps = 3;
+    static constexpr float positionOffset = 0.0f;
+
+    explicit SincInterpolator (const InterpolationTables& tables) noexcept  : table (tables.sinc) {}
+
+    void setDelay (float fraction) noexcept
+    {
+        const float position = fraction*(float) table.numPhases;
+        const int phase = std::min ((int) position, table.numPhases - 1);
+        const float t = position - (float) phase;
+        const float* row = table.getRow (phase);
+        const float* next = table.getRow (phase + 1);
+
+        for (int j = 0; j < numTaps; ++j)
+            weights[j] = Vector::broadcast ((SampleType) (row[j] + t*(next[j] - row[j])));
+    }
+
+    Vector interpolate (const SampleType* taps, int stride, SampleType*) const noexcept
+    {
+        auto sum = weights[0]*Vector::load (taps);
+
+        for (int j = 1; j < numTaps; ++j)
+            sum = sum + weights[j]*Vector::load (taps + j*stride);
+
+        return sum;
+    }
+
+    const PolyphaseTable& table;
+    Vector weights[numTaps];
+};
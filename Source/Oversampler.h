@@ -0,0 +1,431 @@
+/*
+  ==============================================================================
+
+    Oversampler.h
+
+    2x/4x polyphase IIR oversampling for CombEngine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+#include "FloatVector.h"
+
+//==============================================================================
+/** How much CombEngine oversamples the comb kernel by. */
+enum class OversamplingMode
+{
+    off,
+    x2,
+    x4,
+    automatic   // 1x, 2x or 4x depending on how fast the delay is being modulated
+};
+
+//==============================================================================
+/**
+    One 2x stage made of a polyphase pair of allpass chains, the classic
+    elliptic half-band design (Valenzuela & Constantinides). Each allpass section
+    costs a multiply and two adds per sample at the lower rate, and all lanes of
+    an interleaved frame are filtered together with SimdVector.
+
+    A section's previous input is the previous output of the section two before
+    it in the same chain, so only the two chains' inputs and each section's
+    output are kept. With seven sections, that and the coefficients come to the
+    16 vectors SSE has registers for, so a block's filtering stays out of memory.
+*/
+template <typename SampleType>
+class HalfBandStage
+{
+public:
+    using Vector = SimdVector<SampleType>;
+
+    /** Most allpass sections a stage can have. */
+    static constexpr int maxCoefficients = 8;
+
+    /** Designs the allpass coefficients for numCoefficients sections with the
+        given transition bandwidth, as a fraction of the higher sample rate.
+    */
+    void design (int numCoefficients, double transitionBandwidth)
+    {
+        numCoefficients = std::min (numCoefficients, maxCoefficients);
+        coefficients.resize ((size_t) numCoefficients);
+
+        const double pi = 3.141592653589793;
+        const int order = numCoefficients*2 + 1;
+
+        double k = std::tan ((1.0 - transitionBandwidth*2.0)*pi/4.0);
+        k *= k;
+        const double kRoot = std::pow (1.0 - k*k, 0.25);
+        const double e = 0.5*(1.0 - kRoot)/(1.0 + kRoot);
+        const double e4 = e*e*e*e;
+        const double q = e*(1.0 + e4*(2.0 + e4*(15.0 + 150.0*e4)));
+
+        for (int index = 0; index < numCoefficients; ++index)
+        {
+            const int c = index + 1;
+            double num = 0.0, den = 0.0, term = 0.0;
+            double sign = 1.0;
+
+            for (int i = 0; i == 0 || std::abs (term) > 1.0e-100; ++i, sign = -sign)
+            {
+                term = std::pow (q, i*(i + 1))*std::sin ((i*2 + 1)*c*pi/order)*sign;
+                num += term;
+            }
+
+            sign = -1.0;
+
+            for (int i = 1; i == 1 || std::abs (term) > 1.0e-100; ++i, sign = -sign)
+            {
+                term = std::pow (q, i*i)*std::cos (i*2*c*pi/order)*sign;
+                den += term;
+            }
+
+            const double ww = num*std::pow (q, 0.25)/(den + 0.5);
+            const double wwSquared = ww*ww;
+            const double x = std::sqrt ((1.0 - wwSquared*k)*(1.0 - wwSquared/k))/(1.0 + wwSquared);
+
+            coefficients[(size_t) index] = (1.0 - x)/(1.0 + x);
+        }
+    }
+
+    /** Allocates filter state for numLanes interleaved lanes. */
+    void prepare (int newNumLanes)
+    {
+        numLanes = newNumLanes;
+        state.assign ((size_t) ((coefficients.size() + 2)*(size_t) numLanes), SampleType());
+    }
+
+    void reset() noexcept   { std::fill (state.begin(), state.end(), SampleType()); }
+
+    /** Group delay at low frequencies of an upsample followed by a downsample
+        through this stage, in samples at the lower rate.
+    */
+    double getRoundTripDelay() const noexcept
+    {
+        // each section is a first-order allpass in z^-2, with a DC group delay of
+        // 2*(1 - c)/(1 + c) samples at the higher rate. The odd path's extra
+        // sample of delay on the way up is cancelled on the way down
+        double delay = 0.0;
+
+        for (auto c : coefficients)
+            delay += 2.0*(1.0 - c)/(1.0 + c);
+
+        return delay/2.0;
+    }
+
+    /** Group delay at low frequencies of an upsample alone, in samples at the
+        lower rate. Going up, both chains line up with the even one's delay;
+        going down, its input is the later sample of each pair, so the down path
+        is half a sample at the higher rate shorter, and the up path takes a
+        quarter of a sample more than half the round trip.
+    */
+    double getUpDelay() const noexcept      { return getRoundTripDelay()/2.0 + 0.25; }
+
+    /** Doubles the rate of numFrames interleaved frames from src into dest. */
+    void upsample (const SampleType* src, SampleType* dest, int numFrames) noexcept
+    {
+        switch (coefficients.size())
+        {
+            case 7:   upsample<7> (src, dest, numFrames); break;
+            case 3:   upsample<3> (src, dest, numFrames); break;
+            default:  upsample<0> (src, dest, numFrames); break;
+        }
+    }
+
+    /** Halves the rate of numFrames*2 interleaved frames from src into numFrames in dest. */
+    void downsample (const SampleType* src, SampleType* dest, int numFrames) noexcept
+    {
+        switch (coefficients.size())
+        {
+            case 7:   downsample<7> (src, dest, numFrames); break;
+            case 3:   downsample<3> (src, dest, numFrames); break;
+            default:  downsample<0> (src, dest, numFrames); break;
+        }
+    }
+
+private:
+    template <typename> friend class Oversampler;
+
+    // NumCoefficients is the number of allpass sections, or 0 to use coefficients.size()
+    template <int NumCoefficients>
+    void upsample (const SampleType* src, SampleType* dest, int numFrames) noexcept
+    {
+        for (int lane = 0; lane < numLanes; lane += Vector::size)
+        {
+            Sections<NumCoefficients> sections (*this, lane);
+
+            for (int frame = 0; frame < numFrames; ++frame)
+            {
+                auto even = Vector::load (src + frame*numLanes + lane);
+                auto odd = even;
+
+                sections.process (even, odd);
+
+                even.store (dest + (frame*2)*numLanes + lane);
+                odd.store (dest + (frame*2 + 1)*numLanes + lane);
+            }
+
+            sections.save (*this, lane);
+        }
+    }
+
+    template <int NumCoefficients>
+    void downsample (const SampleType* src, SampleType* dest, int numFrames) noexcept
+    {
+        const auto half = Vector::broadcast ((SampleType) 0.5);
+
+        for (int lane = 0; lane < numLanes; lane += Vector::size)
+        {
+            Sections<NumCoefficients> sections (*this, lane);
+
+            for (int frame = 0; frame < numFrames; ++frame)
+            {
+                auto even = Vector::load (src + (frame*2 + 1)*numLanes + lane);
+                auto odd = Vector::load (src + (frame*2)*numLanes + lane);
+
+                sections.process (even, odd);
+
+                (half*(even + odd)).store (dest + frame*numLanes + lane);
+            }
+
+            sections.save (*this, lane);
+        }
+    }
+
+    /** The state of one SimdVector of lanes, held in locals (and with a fixed
+        section count, in registers) for the length of a block rather than going
+        back to memory every sample. The state holds the even and odd chains'
+        last inputs, then each section's last output.
+    */
+    template <int NumCoefficients>
+    struct Sections
+    {
+        Sections (const HalfBandStage& stage, int lane) noexcept
+            : numCoefficients (NumCoefficients > 0 ? NumCoefficients : (int) stage.coefficients.size())
+        {
+            for (int i = 0; i < 2; ++i)
+                inputs[i] = Vector::load (stage.state.data() + i*stage.numLanes + lane);
+
+            for (int i = 0; i < numCoefficients; ++i)
+            {
+                coefficients[i] = Vector::broadcast ((SampleType) stage.coefficients[(size_t) i]);
+                outputs[i] = Vector::load (stage.state.data() + (i + 2)*stage.numLanes + lane);
+            }
+        }
+
+        void save (HalfBandStage& stage, int lane) const noexcept
+        {
+            for (int i = 0; i < 2; ++i)
+                inputs[i].store (stage.state.data() + i*stage.numLanes + lane);
+
+            for (int i = 0; i < numCoefficients; ++i)
+                outputs[i].store (stage.state.data() + (i + 2)*stage.numLanes + lane);
+        }
+
+        /** Runs the two allpass chains, alternating coefficients between them. */
+        void process (Vector& even, Vector& odd) noexcept
+        {
+            // each chain's x[n-1] for the section it has reached
+            Vector previous[2] = { inputs[0], inputs[1] };
+            inputs[0] = even;
+            inputs[1] = odd;
+
+            for (int i = 0; i < numCoefficients; ++i)
+            {
+                auto& x = (i % 2 == 0) ? even : odd;
+                auto& previousInput = previous[i % 2];
+
+                // y[n] = c*(x[n] - y[n-1]) + x[n-1], where each delay is two samples at the
+                // higher rate. This section's y[n-1] is x[n-1] for the next one in the chain
+                const auto y = previousInput + coefficients[i]*(x - outputs[i]);
+                previousInput = outputs[i];
+                outputs[i] = y;
+                x = y;
+            }
+        }
+
+        Vector coefficients[maxCoefficients], inputs[2], outputs[maxCoefficients];
+        const int numCoefficients;
+    };
+
+    std::vector<double> coefficients;
+    std::vector<SampleType> state;
+    int numLanes = Vector::size;
+};
+
+//==============================================================================
+/**
+    Up- and downsamples interleaved frames by 2 or 4 using cascaded
+    HalfBandStages, with separate filter state for each direction. The first
+    stage (nearest the original rate) does the steep filtering; the second only
+    has to clear images well above the audio band, so it gets fewer sections.
+    Both reject about 90 dB, and pass everything up to 0.455 of the original
+    rate (21.8 kHz at 48 kHz) to within 0.0001 dB.
+
+    The kernel in between does factor times the work, and most of that is per
+    frame rather than per channel (the LFO and the read positions), so 2x can't
+    cost less than twice 1x. What oversampling adds beyond that is these
+    filters. They cost about half a 1x linear kernel per host sample at 2x for
+    up to four channels (CombBenchmark, stereo ring mod), which puts 2x at about
+    2.6x the cost of 1x and 4x at about 4.8x. At 4x both stages run in the same
+    pass over the frames: the second stage has too few sections to keep the
+    processor busy while each one waits on its own y[n-1], and the first
+    stage's sections fill the gaps.
+*/
+template <typename SampleType>
+class Oversampler
+{
+public:
+    static constexpr int maxFactor = 4;
+
+    Oversampler()
+    {
+        for (auto* stages : { upStages, downStages })
+        {
+            stages[0].design (firstStageSections, 0.045);
+            stages[1].design (secondStageSections, 0.25);
+        }
+    }
+
+    void prepare (int newNumLanes)
+    {
+        numLanes = newNumLanes;
+
+        for (auto* stages : { upStages, downStages })
+            for (int i = 0; i < numStages; ++i)
+                stages[i].prepare (numLanes);
+
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        for (auto* stages : { upStages, downStages })
+            for (int i = 0; i < numStages; ++i)
+                stages[i].reset();
+    }
+
+    /** Clears the up path only, leaving the down path's state as it is. */
+    void resetUpPath() noexcept
+    {
+        for (int i = 0; i < numStages; ++i)
+            upStages[i].reset();
+    }
+
+    /** Round trip (up then down) latency at low frequencies, in samples at the original rate. */
+    double getLatency (int factor) const noexcept
+    {
+        if (factor == 2)
+            return upStages[0].getRoundTripDelay();
+
+        if (factor == 4)
+            return upStages[0].getRoundTripDelay() + upStages[1].getRoundTripDelay()/2.0;
+
+        return 0.0;
+    }
+
+    /** Latency of the up path alone at low frequencies, in samples at the original rate. */
+    double getUpLatency (int factor) const noexcept
+    {
+        if (factor == 2)
+            return upStages[0].getUpDelay();
+
+        if (factor == 4)
+            return upStages[0].getUpDelay() + upStages[1].getUpDelay()/2.0;
+
+        return 0.0;
+    }
+
+    /** Writes numFrames*factor frames to dest. factor must be 2 or 4. */
+    void upsample (const SampleType* src, SampleType* dest, int numFrames, int factor) noexcept
+    {
+        if (factor != 4)
+        {
+            upStages[0].upsample (src, dest, numFrames);
+            return;
+        }
+
+        for (int lane = 0; lane < numLanes; lane += Vector::size)
+        {
+            FirstSections first (upStages[0], lane);
+            SecondSections second (upStages[1], lane);
+
+            for (int frame = 0; frame < numFrames; ++frame)
+            {
+                auto even = Vector::load (src + frame*numLanes + lane);
+                auto odd = even;
+
+                first.process (even, odd);
+
+                auto evenOfEven = even, oddOfEven = even, evenOfOdd = odd, oddOfOdd = odd;
+
+                second.process (evenOfEven, oddOfEven);
+                second.process (evenOfOdd, oddOfOdd);
+
+                SampleType* frames = dest + (frame*4)*numLanes + lane;
+                evenOfEven.store (frames);
+                oddOfEven.store (frames + numLanes);
+                evenOfOdd.store (frames + 2*numLanes);
+                oddOfOdd.store (frames + 3*numLanes);
+            }
+
+            first.save (upStages[0], lane);
+            second.save (upStages[1], lane);
+        }
+    }
+
+    /** Reads numFrames*factor frames from src. factor must be 2 or 4. */
+    void downsample (const SampleType* src, SampleType* dest, int numFrames, int factor) noexcept
+    {
+        if (factor != 4)
+        {
+            downStages[0].downsample (src, dest, numFrames);
+            return;
+        }
+
+        const auto half = Vector::broadcast ((SampleType) 0.5);
+
+        for (int lane = 0; lane < numLanes; lane += Vector::size)
+        {
+            FirstSections first (downStages[0], lane);
+            SecondSections second (downStages[1], lane);
+
+            for (int frame = 0; frame < numFrames; ++frame)
+            {
+                const SampleType* frames = src + (frame*4)*numLanes + lane;
+                auto evenOfFirst = Vector::load (frames + numLanes), oddOfFirst = Vector::load (frames);
+                auto evenOfSecond = Vector::load (frames + 3*numLanes), oddOfSecond = Vector::load (frames + 2*numLanes);
+
+                second.process (evenOfFirst, oddOfFirst);
+                second.process (evenOfSecond, oddOfSecond);
+
+                auto even = half*(evenOfSecond + oddOfSecond);
+                auto odd = half*(evenOfFirst + oddOfFirst);
+
+                first.process (even, odd);
+
+                (half*(even + odd)).store (dest + frame*numLanes + lane);
+            }
+
+            first.save (downStages[0], lane);
+            second.save (downStages[1], lane);
+        }
+    }
+
+private:
+    using Vector = SimdVector<SampleType>;
+
+    static constexpr int numStages = 2, firstStageSections = 7, secondStageSections = 3;
+
+    using FirstSections = typename HalfBandStage<SampleType>::template Sections<firstStageSections>;
+    using SecondSections = typename HalfBandStage<SampleType>::template Sections<secondStageSections>;
+
+    HalfBandStage<SampleType> upStages[numStages], downStages[numStages];
+    int numLanes = Vector::size;
+};
@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    ParameterAttachments.cpp
+
+  ==============================================================================
+*/
+
+#include "ParameterAttachments.h"
+
+using namespace juce;
+
+//==============================================================================
+CombParameterAttachment::CombParameterAttachment(RangedAudioParameter& p)
+    : parameter(p)
+{
+    parameter.addListener(this);
+}
+
+CombParameterAttachment::~CombParameterAttachment()
+{
+    parameter.removeListener(this);
+}
+
+void CombParameterAttachment::update()
+{
+    if (changed.exchange(false, std::memory_order_acquire))
+        showValue(parameter.convertFrom0to1(parameter.getValue()));
+}
+
+RangedAudioParameter& CombParameterAttachment::findParameter(AudioProcessor& processor, const String& paramID)
+{
+    for (auto* param : processor.getParameters())
+        if (auto* ranged = dynamic_cast<RangedAudioParameter*>(param))
+            if (ranged->paramID == paramID)
+                return *ranged;
+
+    // every control in the editor should have a parameter behind it
+    jassertfalse;
+    return *dynamic_cast<RangedAudioParameter*>(processor.getParameters().getFirst());
+}
+
+void CombParameterAttachment::setValue(float value)
+{
+    const float normalised = parameter.convertTo0to1(value);
+
+    if (normalised != parameter.getValue())
+        parameter.setValueNotifyingHost(normalised);
+}
+
+void CombParameterAttachment::parameterValueChanged(int, float)
+{
+    // may be on the audio thread, so just flag it for the next update()
+    changed.store(true, std::memory_order_release);
+}
+
+//==============================================================================
+CombSliderAttachment::CombSliderAttachment(RangedAudioParameter& p, Slider& s, double valueScale)
+    : CombParameterAttachment(p), slider(s), scale(valueScale)
+{
+    slider.addListener(this);
+    update();
+}
+
+CombSliderAttachment::~CombSliderAttachment()
+{
+    slider.removeListener(this);
+}
+
+void CombSliderAttachment::showValue(float value)
+{
+    slider.setValue(value*scale, dontSendNotification);
+}
+
+void CombSliderAttachment::sliderValueChanged(Slider*)
+{
+    // typed-in values and wheel moves are gestures of their own
+    if (slider.isMouseButtonDown()) {
+        setValue((float)(slider.getValue()/scale));
+    } else {
+        beginGesture();
+        setValue((float)(slider.getValue()/scale));
+        endGesture();
+    }
+}
+
+//==============================================================================
+CombButtonAttachment::CombButtonAttachment(RangedAudioParameter& p, Button& b)
+    : CombParameterAttachment(p), button(b)
+{
+    button.onClick = [this] {
+        beginGesture();
+        setValue(button.getToggleState() ? 1.0f : 0.0f);
+        endGesture();
+    };
+    update();
+}
+
+CombButtonAttachment::~CombButtonAttachment()
+{
+    button.onClick = nullptr;
+}
+
+void CombButtonAttachment::showValue(float value)
+{
+    button.setToggleState(value >= 0.5f, dontSendNotification);
+}
+
+//==============================================================================
+CombComboBoxAttachment::CombComboBoxAttachment(RangedAudioParameter& p, ComboBox& c)
+    : CombParameterAttachment(p), comboBox(c)
+{
+    comboBox.onChange = [this] {
+        beginGesture();
+        setValue((float)comboBox.getSelectedItemIndex());
+        endGesture();
+    };
+    update();
+}
+
+CombComboBoxAttachment::~CombComboBoxAttachment()
+{
+    comboBox.onChange = nullptr;
+}
+
+void CombComboBoxAttachment::showValue(float value)
+{
+    comboBox.setSelectedItemIndex(roundToInt(value), dontSendNotification);
+}
@@ -0,0 +1,106 @@
+/*
+  ==============================================================================
+
+    ParameterAttachments.h
+
+    Two-way links between the editor's controls and the processor's parameters.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/**
+    Keeps one control in step with one parameter, in both directions.
+
+    Parameters can change on any thread, including the audio thread during
+    host automation. The listener callback only raises an atomic flag, and
+    the control is brought up to date the next time update() is called from
+    the message thread. The editor does that for every attachment from a
+    single timer, so any number of changes between two ticks cost one
+    repaint, and nothing is posted to the message queue from the audio thread.
+*/
+class CombParameterAttachment  : private juce::AudioProcessorParameter::Listener
+{
+public:
+    explicit CombParameterAttachment(juce::RangedAudioParameter&);
+    ~CombParameterAttachment() override;
+
+    /** Refreshes the control if the parameter has changed since the last call.
+        Message thread only.
+    */
+    void update();
+
+    /** Finds one of a processor's parameters by its ID. */
+    static juce::RangedAudioParameter& findParameter(juce::AudioProcessor&, const juce::String& paramID);
+
+protected:
+    /** Shows value (in the parameter's own units) on the control. */
+    virtual void showValue(float value) = 0;
+
+    /** Sets the parameter from the control, telling the host. */
+    void setValue(float value);
+    void beginGesture()     { parameter.beginChangeGesture(); }
+    void endGesture()       { parameter.endChangeGesture(); }
+
+    juce::RangedAudioParameter& parameter;
+
+private:
+    void parameterValueChanged(int, float) override;
+    void parameterGestureChanged(int, bool) override {}
+
+    std::atomic<bool> changed { true };
+
+    JUCE_DECLARE_NON_COPYABLE (CombParameterAttachment)
+};
+
+//==============================================================================
+/** Attaches a slider, whose value is the parameter's times scale (e.g. 1000 to show seconds as ms). */
+class CombSliderAttachment  : public CombParameterAttachment,
+                          private juce::Slider::Listener
+{
+public:
+    CombSliderAttachment(juce::RangedAudioParameter&, juce::Slider&, double scale = 1.0);
+    ~CombSliderAttachment() override;
+
+private:
+    void showValue(float) override;
+    void sliderValueChanged(juce::Slider*) override;
+    void sliderDragStarted(juce::Slider*) override   { beginGesture(); }
+    void sliderDragEnded(juce::Slider*) override     { endGesture(); }
+
+    juce::Slider& slider;
+    const double scale;
+};
+
+//==============================================================================
+/** Attaches a toggle button to a boolean parameter. Only clicks change it. */
+class CombButtonAttachment  : public CombParameterAttachment
+{
+public:
+    CombButtonAttachment(juce::RangedAudioParameter&, juce::Button&);
+    ~CombButtonAttachment() override;
+
+private:
+    void showValue(float) override;
+
+    juce::Button& button;
+};
+
+//==============================================================================
+/** Attaches a combo box to a choice parameter, item i being choice i. */
+class CombComboBoxAttachment  : public CombParameterAttachment
+{
+public:
+    CombComboBoxAttachment(juce::RangedAudioParameter&, juce::ComboBox&);
+    ~CombComboBoxAttachment() override;
+
+private:
+    void showValue(float) override;
+
+    juce::ComboBox& comboBox;
+};
@@ -22,9 +22,7 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     delaySlider.setColour(Slider::textBoxTextColourId, Colours::black);
     delaySlider.setTextBoxIsEditable(true);
     delaySlider.setRange(0, 500, 1);
-    delaySlider.setValue(0);
     delaySlider.setTextValueSuffix(" ms");
-    delaySlider.addListener(this);
     // label
     addAndMakeVisible(delayLabel);
     delayLabel.setText("min. delay", juce::dontSendNotification);
@@ -38,9 +36,7 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     widthSlider.setColour(Slider::textBoxTextColourId, Colours::black);
     widthSlider.setTextBoxIsEditable(true);
     widthSlider.setRange(0.0f, 5.0f, 0.01f); // maxSweepWidth = 5 ms
-    widthSlider.setValue(2.0f); // TODO: is this intialized to 0.0003 in slidervaluechanged? probably not...
     widthSlider.setTextValueSuffix(" ms");
-    widthSlider.addListener(this);
     // label
     addAndMakeVisible(widthLabel);
     widthLabel.setText("mod depth", juce::dontSendNotification);
@@ -54,9 +50,7 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     freqSlider.setColour(Slider::textBoxTextColourId, Colours::black);
     freqSlider.setTextBoxIsEditable(true);
     freqSlider.setRange(0.0f, 250.0f, 0.01f);
-    freqSlider.setValue(0.5f);
     freqSlider.setTextValueSuffix(" Hz");
-    freqSlider.addListener(this);
     // label
     addAndMakeVisible(freqLabel);
     freqLabel.setText("lfo frequency", juce::dontSendNotification);
@@ -70,8 +64,6 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     bleedSlider.setColour(Slider::textBoxTextColourId, Colours::black);
     bleedSlider.setTextBoxIsEditable(true);
     bleedSlider.setRange(0.0f, 1.0f, 0.01f);
-    bleedSlider.setValue(0.7f);
-    bleedSlider.addListener(this);
     // label
     addAndMakeVisible(bleedLabel);
     bleedLabel.setText("bleed", juce::dontSendNotification);
@@ -85,8 +77,6 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     feedforwardSlider.setColour(Slider::textBoxTextColourId, Colours::black);
     feedforwardSlider.setTextBoxIsEditable(true);
     feedforwardSlider.setRange(0.0f, 1.0f, 0.01f);
-    feedforwardSlider.setValue(0.7f);
-    feedforwardSlider.addListener(this);
     // label
     addAndMakeVisible(feedforwardLabel);
     feedforwardLabel.setText("feedforward", juce::dontSendNotification);
@@ -100,8 +90,6 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     feedbackSlider.setColour(Slider::textBoxTextColourId, Colours::black);
     feedbackSlider.setTextBoxIsEditable(true);
     feedbackSlider.setRange(0.0f, 1.0f, 0.01f);
-    feedbackSlider.setValue(0.7f);
-    feedbackSlider.addListener(this);
     // label
     addAndMakeVisible(feedbackLabel);
     feedbackLabel.setText("feedback", dontSendNotification);
@@ -110,7 +98,114 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     
     addAndMakeVisible(tremoloToggle);
     tremoloToggle.setButtonText("(+ tremolo)");
-    tremoloToggle.addListener(this);
+    
+    /* interpolation quality */
+    addAndMakeVisible(interpolationBox);
+    interpolationBox.addItemList(StringArray("linear", "cubic", "allpass", "sinc"), 1);
+    // label
+    addAndMakeVisible(interpolationLabel);
+    interpolationLabel.setText("interpolation", dontSendNotification);
+    interpolationLabel.setJustificationType(Justification::centred);
+    interpolationLabel.attachToComponent(&interpolationBox, false);
+    
+    /* oversampling */
+    addAndMakeVisible(oversamplingBox);
+    oversamplingBox.addItemList(StringArray("off", "2x", "4x", "auto"), 1);
+    // label
+    addAndMakeVisible(oversamplingLabel);
+    oversamplingLabel.setText("oversampling", dontSendNotification);
+    oversamplingLabel.setJustificationType(Justification::centred);
+    oversamplingLabel.attachToComponent(&oversamplingBox, false);
+    
+    /* maximum delay */
+    addAndMakeVisible(maxDelayBox);
+    maxDelayBox.addItemList(StringArray("50 ms", "100 ms", "250 ms", "550 ms"), 1);
+    // label
+    addAndMakeVisible(maxDelayLabel);
+    maxDelayLabel.setText("max. delay", dontSendNotification);
+    maxDelayLabel.setJustificationType(Justification::centred);
+    maxDelayLabel.attachToComponent(&maxDelayBox, false);
+    
+    /* preset */
+    addAndMakeVisible(presetBox);
+    for (int i = 0; i < audioProcessor.getNumPrograms(); ++i)
+        presetBox.addItem(audioProcessor.getProgramName(i), i + 1);
+    presetBox.setSelectedItemIndex(audioProcessor.getCurrentProgram(), dontSendNotification);
+    presetBox.onChange = [this] { audioProcessor.setCurrentProgram(presetBox.getSelectedItemIndex()); };
+    // label
+    addAndMakeVisible(presetLabel);
+    presetLabel.setText("preset", dontSendNotification);
+    presetLabel.setJustificationType(Justification::centred);
+    presetLabel.attachToComponent(&presetBox, false);
+    
+    /* preset morph time */
+    addAndMakeVisible(morphSlider);
+    morphSlider.setSliderStyle(Slider::SliderStyle::LinearHorizontal);
+    morphSlider.setTextBoxStyle(Slider::TextEntryBoxPosition::TextBoxRight, true, 50, 20);
+    morphSlider.setTextBoxIsEditable(true);
+    morphSlider.setRange(0.0f, 5.0f, 0.1f);
+    morphSlider.setTextValueSuffix(" s");
+    // label
+    addAndMakeVisible(morphLabel);
+    morphLabel.setText("morph time", dontSendNotification);
+    morphLabel.setJustificationType(Justification::centred);
+    morphLabel.attachToComponent(&morphSlider, false);
+    
+    /* voices */
+    addAndMakeVisible(voicesSlider);
+    voicesSlider.setSliderStyle(Slider::SliderStyle::RotaryVerticalDrag);
+    voicesSlider.setTextBoxStyle(Slider::TextEntryBoxPosition::TextBoxBelow, true, 60, 20);
+    voicesSlider.setTextBoxIsEditable(true);
+    voicesSlider.setRange(1, maxCombVoices, 1);
+    // label
+    addAndMakeVisible(voicesLabel);
+    voicesLabel.setText("voices", dontSendNotification);
+    voicesLabel.setJustificationType(Justification::centred);
+    voicesLabel.attachToComponent(&voicesSlider, false);
+    
+    /* voice phase spread */
+    addAndMakeVisible(spreadSlider);
+    spreadSlider.setSliderStyle(Slider::SliderStyle::RotaryVerticalDrag);
+    spreadSlider.setTextBoxStyle(Slider::TextEntryBoxPosition::TextBoxBelow, true, 60, 20);
+    spreadSlider.setTextBoxIsEditable(true);
+    spreadSlider.setRange(0.0f, 1.0f, 0.01f);
+    // label
+    addAndMakeVisible(spreadLabel);
+    spreadLabel.setText("voice spread", dontSendNotification);
+    spreadLabel.setJustificationType(Justification::centred);
+    spreadLabel.attachToComponent(&spreadSlider, false);
+    
+    /* comb bank */
+    addAndMakeVisible(bankBox);
+    bankBox.addItemList(StringArray("off", "reverb", "resonator"), 1);
+    // label
+    addAndMakeVisible(bankLabel);
+    bankLabel.setText("comb bank", dontSendNotification);
+    bankLabel.setJustificationType(Justification::centred);
+    bankLabel.attachToComponent(&bankBox, false);
+    
+    for (auto* bankSlider : { &bankSizeSlider, &bankDecaySlider, &bankMixSlider }) {
+        addAndMakeVisible(bankSlider);
+        bankSlider->setSliderStyle(Slider::SliderStyle::RotaryVerticalDrag);
+        bankSlider->setTextBoxStyle(Slider::TextEntryBoxPosition::TextBoxBelow, true, 50, 20);
+        bankSlider->setTextBoxIsEditable(true);
+        bankSlider->setRange(0.0f, 1.0f, 0.01f);
+    }
+    
+    addAndMakeVisible(bankSizeLabel);
+    bankSizeLabel.setText("size", dontSendNotification);
+    bankSizeLabel.setJustificationType(Justification::centred);
+    bankSizeLabel.attachToComponent(&bankSizeSlider, false);
+    
+    addAndMakeVisible(bankDecayLabel);
+    bankDecayLabel.setText("decay", dontSendNotification);
+    bankDecayLabel.setJustificationType(Justification::centred);
+    bankDecayLabel.attachToComponent(&bankDecaySlider, false);
+    
+    addAndMakeVisible(bankMixLabel);
+    bankMixLabel.setText("mix", dontSendNotification);
+    bankMixLabel.setJustificationType(Justification::centred);
+    bankMixLabel.attachToComponent(&bankMixSlider, false);
     
     addAndMakeVisible(inputLabel);
     inputLabel.setText("x[n]", dontSendNotification);
@@ -125,6 +220,19 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     title.setJustificationType(Justification::centred);
     title.setFont(Font("Helvetica", 32, Font::FontStyleFlags::italic));
     
+   #if COMB_PROFILING
+    addAndMakeVisible(profilerLabel);
+    profilerLabel.setFont(Font(Font::getDefaultMonospacedFontName(), 12, Font::plain));
+    
+    addAndMakeVisible(profilerResetButton);
+    profilerResetButton.setButtonText("reset");
+    profilerResetButton.onClick = [this] { audioProcessor.getProfiler().reset(); };
+    
+    addAndMakeVisible(profilerExportButton);
+    profilerExportButton.setButtonText("export...");
+    profilerExportButton.onClick = [this] { exportProfile(); };
+   #endif
+    
     getLookAndFeel().setColour(Label::textColourId, Colours::black);
     getLookAndFeel().setColour(Slider::textBoxTextColourId, Colours::black);
     getLookAndFeel().setColour(Slider::textBoxOutlineColourId, Colours::transparentWhite);
@@ -135,15 +243,76 @@ UniversalCombFilterAudioProcessorEditor::UniversalCombFilterAudioProcessorEditor
     getLookAndFeel().setColour(ToggleButton::tickColourId, Colours::black);
     getLookAndFeel().setColour(ToggleButton::tickDisabledColourId, Colours::black);
     
+    // every control follows its parameter, whoever changes it
+    auto attach = [this] (auto* attachment) { attachments.emplace_back(attachment); };
+    auto param = [&p] (const char* paramID) -> RangedAudioParameter& { return CombParameterAttachment::findParameter(p, paramID); };
+    
+    attach(new CombSliderAttachment(param("sweepwidth"), widthSlider, 1000.0));
+    attach(new CombSliderAttachment(param("lfofreq"), freqSlider));
+    attach(new CombSliderAttachment(param("bleed"), bleedSlider));
+    attach(new CombSliderAttachment(param("feedforward"), feedforwardSlider));
+    attach(new CombSliderAttachment(param("feedback"), feedbackSlider));
+    attach(new CombSliderAttachment(param("delay"), delaySlider, 1000.0));
+    attach(new CombButtonAttachment(param("tremolo"), tremoloToggle));
+    attach(new CombComboBoxAttachment(param("interpolation"), interpolationBox));
+    attach(new CombComboBoxAttachment(param("oversampling"), oversamplingBox));
+    attach(new CombComboBoxAttachment(param("maxdelay"), maxDelayBox));
+    attach(new CombSliderAttachment(param("morphtime"), morphSlider));
+    attach(new CombSliderAttachment(param("voices"), voicesSlider));
+    attach(new CombSliderAttachment(param("voicespread"), spreadSlider));
+    attach(new CombComboBoxAttachment(param("bank"), bankBox));
+    attach(new CombSliderAttachment(param("banksize"), bankSizeSlider));
+    attach(new CombSliderAttachment(param("bankdecay"), bankDecaySlider));
+    attach(new CombSliderAttachment(param("bankmix"), bankMixSlider));
+    
+    setOpaque(true);
     setSize(800, 600);
+    audioProcessor.setTelemetryEnabled(true);
+    startTimerHz(30);
 }
 
 UniversalCombFilterAudioProcessorEditor::~UniversalCombFilterAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.setTelemetryEnabled(false);
 }
 
 //==============================================================================
 void UniversalCombFilterAudioProcessorEditor::paint (juce::Graphics& g)
+{
+    g.drawImage(background, getLocalBounds().toFloat());
+    
+    // the read head moves along the bottom of the delay box with the LFO
+    const auto track = tapArea.toFloat().reduced(4.0f, 0.0f);
+    const float trackY = track.getBottom() - 4.0f;
+    g.setColour(Colours::lightgrey);
+    g.drawLine(track.getX(), trackY, track.getRight(), trackY, 2.0f);
+    g.setColour(Colours::orange);
+    g.fillEllipse(track.getX() + track.getWidth()*telemetry.lfo - 4.0f, trackY - 4.0f, 8.0f, 8.0f);
+    g.setColour(Colours::black);
+    g.setFont(12.0f);
+    g.drawText("M = " + String(telemetry.delaySeconds*1000.0f, 2) + " ms", tapArea.withHeight(14), Justification::centredRight);
+    
+    drawMeter(g, inputMeterArea, telemetry.inputPeak, telemetry.inputRms);
+    drawMeter(g, outputMeterArea, telemetry.outputPeak, telemetry.outputRms);
+}
+
+void UniversalCombFilterAudioProcessorEditor::drawMeter(juce::Graphics& g, juce::Rectangle<int> area, float peak, float rms)
+{
+    // -60 dB at the bottom to 0 dB at the top
+    const auto toHeight = [area] (float level) {
+        return jlimit(0.0f, 1.0f, 1.0f + Decibels::gainToDecibels(level, -60.0f)/60.0f)*(float)area.getHeight();
+    };
+    
+    g.setColour(Colours::lightgrey);
+    g.fillRect(area);
+    g.setColour(Colours::orange);
+    g.fillRect(area.toFloat().removeFromBottom(toHeight(rms)));
+    g.setColour(Colours::black);
+    g.fillRect((float)area.getX(), (float)area.getBottom() - toHeight(peak), (float)area.getWidth(), 1.0f);
+}
+
+void UniversalCombFilterAudioProcessorEditor::drawDiagram(juce::Graphics& g)
 {
     g.fillAll(Colours::whitesmoke);
     
@@ -178,6 +347,15 @@ void UniversalCombFilterAudioProcessorEditor::paint (juce::Graphics& g)
 
 void UniversalCombFilterAudioProcessorEditor::resized()
 {
+    // render the diagram at the display's resolution, so it stays sharp
+    const float scale = Component::getApproximateScaleFactorForComponent(this);
+    background = Image(Image::RGB, jmax(1, roundToInt(getWidth()*scale)), jmax(1, roundToInt(getHeight()*scale)), false);
+    {
+        Graphics g(background);
+        g.addTransform(AffineTransform::scale(scale));
+        drawDiagram(g);
+    }
+    
     delaySlider.setBounds(getWidth()/2-40, getHeight()/2-90, 80, 80);
     widthSlider.setBounds(getWidth()/2-100, getHeight()/2+20, 80, 80);
     freqSlider.setBounds(getWidth()/2+10, getHeight()/2+20, 100, 80);
@@ -189,6 +367,10 @@ void UniversalCombFilterAudioProcessorEditor::resized()
     inputLabel.setBounds(getWidth()/2-344, getHeight()/2-12, 48, 24);
     outputLabel.setBounds(getWidth()/2+296, getHeight()/2-12, 48, 24);
     
+    tapArea.setBounds(getWidth()/2-116, getHeight()/2+98, 232, 20);
+    inputMeterArea.setBounds(getWidth()/2-323, getHeight()/2+20, 6, 80);
+    outputMeterArea.setBounds(getWidth()/2+317, getHeight()/2+20, 6, 80);
+    
     Font font = Font("Helvetica", 32, Font::FontStyleFlags::italic);
     int titleWidth = font.getStringWidth("Universal Comb Filter");
     int titleHeight = font.getHeight();
@@ -196,45 +378,123 @@ void UniversalCombFilterAudioProcessorEditor::resized()
     title.setJustificationType(Justification::centredLeft);
     
     tremoloToggle.setBounds(getWidth()/2+21, getHeight()/2+166, 120, 40);
+    
+    voicesSlider.setBounds(getWidth()/2+200, getHeight()/2-270, 80, 80);
+    spreadSlider.setBounds(getWidth()/2+290, getHeight()/2-270, 80, 80);
+    
+    bankBox.setBounds(getWidth()/2-380, getHeight()/2-180, 120, 24);
+    bankSizeSlider.setBounds(getWidth()/2-390, getHeight()/2-110, 60, 70);
+    bankDecaySlider.setBounds(getWidth()/2-330, getHeight()/2-110, 60, 70);
+    bankMixSlider.setBounds(getWidth()/2-270, getHeight()/2-110, 60, 70);
+    
+    interpolationBox.setBounds(getWidth()/2-380, getHeight()/2+250, 120, 24);
+    oversamplingBox.setBounds(getWidth()/2-250, getHeight()/2+250, 120, 24);
+    maxDelayBox.setBounds(getWidth()/2-120, getHeight()/2+250, 120, 24);
+    presetBox.setBounds(getWidth()/2+10, getHeight()/2+250, 120, 24);
+    morphSlider.setBounds(getWidth()/2+140, getHeight()/2+250, 160, 24);
+    
+   #if COMB_PROFILING
+    profilerLabel.setBounds(10, 8, 340, 36);
+    profilerResetButton.setBounds(14, 46, 60, 20);
+    profilerExportButton.setBounds(80, 46, 70, 20);
+   #endif
 }
 
-void UniversalCombFilterAudioProcessorEditor::sliderValueChanged(Slider* slider)
+void UniversalCombFilterAudioProcessorEditor::timerCallback()
 {
-    auto& audioParams = audioProcessor.getParameters();
-    if (slider == &widthSlider) {
-        AudioParameterFloat* widthParam = (AudioParameterFloat*) audioParams.getUnchecked(0);
-        *widthParam = (float)widthSlider.getValue()/1000.0f;
-    } else if (slider == &freqSlider) {
-        AudioParameterFloat* freqParam = (AudioParameterFloat*) audioParams.getUnchecked(1);
-        *freqParam = freqSlider.getValue();
-    } else if (slider == &bleedSlider) {
-        AudioParameterFloat* bleedParam = (AudioParameterFloat*) audioParams.getUnchecked(2);
-        *bleedParam = bleedSlider.getValue();
-    }  else if (slider == &feedforwardSlider) {
-        AudioParameterFloat* feedforwardParam = (AudioParameterFloat*) audioParams.getUnchecked(3);
-        *feedforwardParam = feedforwardSlider.getValue();
-    }  else if (slider == &feedbackSlider) {
-        AudioParameterFloat* feedbackParam = (AudioParameterFloat*) audioParams.getUnchecked(4);
-        *feedbackParam = feedbackSlider.getValue();
-    }  else if (slider == &delaySlider) {
-        AudioParameterFloat* delayParam = (AudioParameterFloat*) audioParams.getUnchecked(5);
-        *delayParam = (float)delaySlider.getValue()/1000.0f;
+    // parameter changes since the last tick, from the host, automation or presets
+    for (auto& attachment : attachments)
+        attachment->update();
+    
+    // everything the audio thread has sent since the last tick: the latest
+    // read head position, and the loudest levels. Without any (stopped, or
+    // bypassed), the meters fall away
+    UniversalCombFilterAudioProcessor::TelemetryFrame frame;
+    float inputPeak = 0.0f, outputPeak = 0.0f, inputRms = 0.0f, outputRms = 0.0f;
+    bool received = false;
+    
+    while (audioProcessor.popTelemetry(frame)) {
+        telemetry.delaySeconds = frame.delaySeconds;
+        telemetry.lfo = frame.lfo;
+        inputPeak = jmax(inputPeak, frame.inputPeak);
+        outputPeak = jmax(outputPeak, frame.outputPeak);
+        inputRms = jmax(inputRms, frame.inputRms);
+        outputRms = jmax(outputRms, frame.outputRms);
+        received = true;
+    }
+    
+    const bool falling = ! received && telemetry.inputPeak + telemetry.outputPeak > 0.0f;
+    const auto fall = [] (float level) { return level > 0.001f ? level*0.7f : 0.0f; };
+    
+    if (received) {
+        telemetry.inputPeak = inputPeak;
+        telemetry.outputPeak = outputPeak;
+        telemetry.inputRms = inputRms;
+        telemetry.outputRms = outputRms;
+    } else if (falling) {
+        telemetry.inputPeak = fall(telemetry.inputPeak);
+        telemetry.outputPeak = fall(telemetry.outputPeak);
+        telemetry.inputRms = fall(telemetry.inputRms);
+        telemetry.outputRms = fall(telemetry.outputRms);
     }
+    
+    // only the live parts are redrawn, and only when they have changed
+    if (received || falling) {
+        repaint(tapArea);
+        repaint(inputMeterArea);
+        repaint(outputMeterArea);
+    }
+    
+    if (presetBox.getSelectedItemIndex() != audioProcessor.getCurrentProgram())
+        presetBox.setSelectedItemIndex(audioProcessor.getCurrentProgram(), dontSendNotification);
+    
+   #if COMB_PROFILING
+    if (++profilerTicks >= 15) {
+        profilerTicks = 0;
+        updateProfilerStats();
+    }
+   #endif
 }
 
-void UniversalCombFilterAudioProcessorEditor::buttonClicked(Button* button)
+#if COMB_PROFILING
+void UniversalCombFilterAudioProcessorEditor::updateProfilerStats()
 {
-    return;
+    const auto stats = audioProcessor.getProfiler().getStats();
+    
+    if (stats.numBlocks == 0) {
+        profilerLabel.setText("no blocks timed yet", dontSendNotification);
+        return;
+    }
+    
+    // block times in microseconds, load as a share of each block's duration
+    profilerLabel.setText(String::formatted("block p50 %.1f  p99 %.1f  max %.1f us\n%.1f ns/sample  load %.1f%% (p99 %.1f%%, max %.1f%%)",
+                                            stats.p50Ns*1.0e-3, stats.p99Ns*1.0e-3, stats.maxNs*1.0e-3, stats.nsPerSample,
+                                            stats.meanLoad*100.0, stats.p99Load*100.0, stats.maxLoad*100.0),
+                          dontSendNotification);
 }
 
-void UniversalCombFilterAudioProcessorEditor::buttonStateChanged(Button* button)
+void UniversalCombFilterAudioProcessorEditor::exportProfile()
 {
-    auto& audioParams = audioProcessor.getParameters();
-    if (button == &tremoloToggle) {
-        AudioParameterBool* tremoloParam = (AudioParameterBool*) audioParams.getUnchecked(6);
-        *tremoloParam = tremoloToggle.getToggleState();
-    }
+    // the statistics go to the chosen file, and the recent blocks as a Chrome
+    // trace next to it
+    profilerChooser = std::make_unique<FileChooser>("Export profile",
+                                                    File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("UniversalCombFilter-profile.json"),
+                                                    "*.json");
+    
+    const auto flags = FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles | FileBrowserComponent::warnAboutOverwriting;
+    
+    profilerChooser->launchAsync(flags, [this] (const FileChooser& chooser) {
+        const auto file = chooser.getResult();
+        
+        if (file == File())
+            return;
+        
+        const auto& profiler = audioProcessor.getProfiler();
+        file.replaceWithText(profiler.toJson());
+        file.getSiblingFile(file.getFileNameWithoutExtension() + ".trace.json").replaceWithText(profiler.toChromeTrace());
+    });
 }
+#endif
 
 void UniversalCombFilterAudioProcessorEditor::drawSum(juce::Graphics& g, float x, float y)
 {
@@ -10,6 +10,7 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "ParameterAttachments.h"
 
 using namespace juce;
 
@@ -17,8 +18,7 @@ using namespace juce;
 /**
 */
 class UniversalCombFilterAudioProcessorEditor  : public juce::AudioProcessorEditor,
-                                                 public juce::Slider::Listener,
-                                                 public juce::Button::Listener
+                                                 private juce::Timer
 {
 public:
     UniversalCombFilterAudioProcessorEditor (UniversalCombFilterAudioProcessor&);
@@ -27,12 +27,18 @@ public:
     //==============================================================================
     void paint (juce::Graphics&) override;
     void resized() override;
-    void sliderValueChanged(Slider*) override;
-    void buttonClicked(Button*) override;
-    void buttonStateChanged(Button*) override;
     void drawSum(juce::Graphics&, float, float);
 
 private:
+    void drawDiagram(juce::Graphics&);
+    void drawMeter(juce::Graphics&, juce::Rectangle<int>, float peak, float rms);
+    void timerCallback() override;
+   #if COMB_PROFILING
+    void updateProfilerStats();
+    void exportProfile();
+   #endif
+    
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     UniversalCombFilterAudioProcessor& audioProcessor;
@@ -59,9 +65,60 @@ private:
     
     ToggleButton tremoloToggle;
     
+    ComboBox interpolationBox;
+    Label interpolationLabel;
+    
+    ComboBox oversamplingBox;
+    Label oversamplingLabel;
+    
+    ComboBox maxDelayBox;
+    Label maxDelayLabel;
+    
+    ComboBox presetBox;
+    Label presetLabel;
+    
+    Slider morphSlider;
+    Label morphLabel;
+    
+    Slider voicesSlider;
+    Label voicesLabel;
+    
+    Slider spreadSlider;
+    Label spreadLabel;
+    
+    ComboBox bankBox;
+    Label bankLabel;
+    
+    Slider bankSizeSlider;
+    Label bankSizeLabel;
+    
+    Slider bankDecaySlider;
+    Label bankDecayLabel;
+    
+    Slider bankMixSlider;
+    Label bankMixLabel;
+    
     Label inputLabel;
     Label outputLabel;
     Label title;
+    
+    // the block diagram never changes, so it's drawn once per size
+    Image background;
+    
+    std::vector<std::unique_ptr<CombParameterAttachment>> attachments;
+    
+    // what the kernel is doing, drawn over the diagram: the read head's
+    // position in the sweep, and the input and output levels
+    UniversalCombFilterAudioProcessor::TelemetryFrame telemetry;
+    Rectangle<int> tapArea, inputMeterArea, outputMeterArea;
+    
+   #if COMB_PROFILING
+    // processBlock timing, refreshed every few ticks
+    Label profilerLabel;
+    TextButton profilerResetButton, profilerExportButton;
+    std::unique_ptr<FileChooser> profilerChooser;
+    int profilerTicks = 0;
+   #endif
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UniversalCombFilterAudioProcessorEditor)
 };
@@ -23,7 +23,6 @@ UniversalCombFilterAudioProcessor::UniversalCombFilterAudioProcessor()
                      #endif
                        ),
 #endif
-    delayBuffer(2,1)
 {
     addParameter(sweepWidth = new AudioParameterFloat("sweepwidth", "Sweep Width", NormalisableRange<float>(0.0f, 0.05f), 0.002f));
     addParameter(lfoFreq = new AudioParameterFloat("lfofreq", "LFO Frequency", 0.0f, 250.0f, 0.5f));
@@ -32,12 +31,25 @@ UniversalCombFilterAudioProcessor::UniversalCombFilterAudioProcessor()
     addParameter(feedback = new AudioParameterFloat("feedback", "Feedback", 0.0f, 1.0f, 0.7f));
     addParameter(delay = new AudioParameterFloat("delay", "Minimum Delay", 0.0f, 0.5f, 0.0f));
     addParameter(tremolo = new AudioParameterBool("tremolo", "Tremolo", false));
+    addParameter(interpolation = new AudioParameterChoice("interpolation", "Interpolation", StringArray("Linear", "Cubic", "Allpass", "Sinc"), 0));
+    addParameter(oversampling = new AudioParameterChoice("oversampling", "Oversampling", StringArray("Off", "2x", "4x", "Auto"), 0));
+    addParameter(maxDelay = new AudioParameterChoice("maxdelay", "Maximum Delay", StringArray("50 ms", "100 ms", "250 ms", "550 ms"), 3));
+    addParameter(morphTime = new AudioParameterFloat("morphtime", "Preset Morph Time", 0.0f, 5.0f, 0.0f));
+    addParameter(voices = new AudioParameterInt("voices", "Voices", 1, maxCombVoices, 1));
+    addParameter(voiceSpread = new AudioParameterFloat("voicespread", "Voice Spread", 0.0f, 1.0f, 1.0f));
+    addParameter(bankLayout = new AudioParameterChoice("bank", "Comb Bank", StringArray("Off", "Reverb", "Resonator"), 0));
+    addParameter(bankSize = new AudioParameterFloat("banksize", "Bank Size", 0.0f, 1.0f, 0.5f));
+    addParameter(bankDecay = new AudioParameterFloat("bankdecay", "Bank Decay", 0.0f, 1.0f, 0.5f));
+    addParameter(bankMix = new AudioParameterFloat("bankmix", "Bank Mix", 0.0f, 1.0f, 0.3f));
     
-    delayWrite = 0;
+    // raising the maximum delay while playing grows the delay line from the
+    // timer, and the bank is allocated and cleared there, off the audio thread
+    startTimerHz(20);
 }
 
 UniversalCombFilterAudioProcessor::~UniversalCombFilterAudioProcessor()
 {
+    stopTimer();
 }
 
 //==============================================================================
@@ -75,43 +87,171 @@ bool UniversalCombFilterAudioProcessor::isMidiEffect() const
 
 double UniversalCombFilterAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // the feedback loop keeps ringing after the input stops, for as long as it
+    // takes to decay to silence (or forever, at full feedback), the bank rings
+    // on after that, and all of it comes out the latency later
+    const double sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    
+    return CombEngine<float>::getTailLengthSeconds(getCurrentParameters(), sampleRate)
+         + CombBank<float>::getTailLengthSeconds(getBankParameters())
+         + getLatencySamples()/sampleRate;
 }
 
 int UniversalCombFilterAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return numCombPresets;
 }
 
 int UniversalCombFilterAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void UniversalCombFilterAudioProcessor::setCurrentProgram (int index)
 {
+    if (! isPositiveAndBelow(index, numCombPresets))
+        return;
+    
+    const auto& preset = combPresets[index];
+    currentProgram = index;
+    
+    CombParameters params = getCurrentParameters();
+    preset.applyTo(params);
+    int generation;
+    
+    {
+        const ScopedLock sl(programLock);
+        generation = ++programGeneration;
+        queuedProgram = params;
+        queuedMorphSeconds = morphTime->get();
+        queuedGeneration = generation;
+    }
+    
+    publishQueuedProgram();
+    
+    // now let the host and editor know. Until this is finished the audio
+    // thread carries on with the copy it was given, or holds still until
+    // the timer has managed to give it one
+    *feedforward = preset.feedforward;
+    *feedback = preset.feedback;
+    *bleed = preset.bleed;
+    *delay = preset.delay;
+    *sweepWidth = preset.sweepWidth;
+    *lfoFreq = preset.lfoFreq;
+    *tremolo = preset.tremolo;
+    parametersWrittenGeneration.store(generation, std::memory_order_release);
+}
+
+/** Tries once to put the queued program change in the slot. That only fails
+    while the audio thread is copying the previous change out, and then the
+    change stays queued for the timer to try again.
+*/
+void UniversalCombFilterAudioProcessor::publishQueuedProgram()
+{
+    const ScopedLock sl(programLock);
+    
+    if (publishedGeneration == queuedGeneration)
+        return;
+    
+    // a ready change that hasn't been picked up yet is simply replaced
+    int state = programSlotState.load(std::memory_order_relaxed);
+    
+    if ((state != slotFree && state != slotReady)
+        || ! programSlotState.compare_exchange_strong(state, slotWriting, std::memory_order_acquire))
+        return;
+    
+    pendingProgram = queuedProgram;
+    pendingMorphSeconds = queuedMorphSeconds;
+    pendingGeneration = queuedGeneration;
+    programSlotState.store(slotReady, std::memory_order_release);
+    publishedGeneration = queuedGeneration;
 }
 
 const juce::String UniversalCombFilterAudioProcessor::getProgramName (int index)
 {
-    return {};
+    if (! isPositiveAndBelow(index, numCombPresets))
+        return {};
+    
+    return combPresets[index].name;
 }
 
 void UniversalCombFilterAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
+    // the factory bank is read-only
 }
 
 //==============================================================================
+/** Prepares a bank with room for any of the layouts on the menu, at any size,
+    so changing between them never needs a new allocation, and clears it.
+*/
+template <typename SampleType>
+static void prepareBank (CombBank<SampleType>& bank, double sampleRate, int numChannels)
+{
+    int maxLanes = 0;
+    float maxDelay = 0.0f;
+    
+    for (int layout = 0; layout < (int)CombBankLayout::numLayouts; ++layout) {
+        for (float size : { 0.0f, 1.0f }) {
+            const auto bankParams = makeCombBank((CombBankLayout)layout, size, 1.0f, 1.0f);
+            maxLanes = jmax(maxLanes, CombBank<SampleType>::getNumLanes(bankParams));
+            maxDelay = jmax(maxDelay, bankParams.getMaxDelay());
+        }
+    }
+    
+    bank.prepare(sampleRate, numChannels, maxLanes, maxDelay);
+}
+
 void UniversalCombFilterAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Initialize delay buffer
-    delayBufferLength = (int)(0.55*sampleRate) + 3; // max 0.55s delay
-    delayBuffer.setSize(2, delayBufferLength);
-    delayBuffer.clear();
-    lfoPhase = 0.0f;
+    // Initialize delay lines (sized for the maximum delay) and LFO, one lane
+    // per channel of whatever layout the host negotiated. Preparing again with
+    // the same or smaller sizes reuses the existing buffers, and a larger
+    // maximum delay grows them here, without waiting for the timer
+    const int numChannels = jmax(1, getTotalNumInputChannels());
+    lastBlockParameters = getCurrentParameters();
+    
+    if (isUsingDoublePrecision()) {
+        doubleEngine.setParameters(getCurrentParameters());
+        doubleEngine.prepare(sampleRate, numChannels, samplesPerBlock);
+        setLatencySamples(doubleEngine.getLatencySamples());
+    } else {
+        floatEngine.setParameters(getCurrentParameters());
+        floatEngine.prepare(sampleRate, numChannels, samplesPerBlock);
+        setLatencySamples(floatEngine.getLatencySamples());
+    }
+    
+    // the bank is prepared now only if a layout is already selected, and
+    // otherwise by the timer once one is
+    {
+        const ScopedLock sl(bankLock);
+        bankSampleRate = sampleRate;
+        bankNumChannels = numChannels;
+        bankState.store(bankStale, std::memory_order_release);
+    }
     
-    samplePeriod = 1.0f/sampleRate;
+    prepareBankIfNeeded();
+}
+
+/** Gets the bank ready for the audio thread once a layout is selected: the
+    first time it allocates it, and after the bank has been switched off or to
+    another layout it clears out the old tail, so the audio thread never pays
+    for either.
+*/
+void UniversalCombFilterAudioProcessor::prepareBankIfNeeded()
+{
+    const ScopedLock sl(bankLock);
+    const int layout = bankLayout->getIndex();
+    
+    if (bankSampleRate <= 0.0 || layout == 0 || bankState.load(std::memory_order_acquire) != bankStale)
+        return;
+    
+    if (isUsingDoublePrecision())
+        prepareBank(doubleBank, bankSampleRate, bankNumChannels);
+    else
+        prepareBank(floatBank, bankSampleRate, bankNumChannels);
+    
+    readyBankLayout = layout;
+    bankState.store(bankReady, std::memory_order_release);
 }
 
 void UniversalCombFilterAudioProcessor::releaseResources()
@@ -127,12 +267,12 @@ bool UniversalCombFilterAudioProcessor::isBusesLayoutSupported (const BusesLayou
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Every channel gets its own lane of the delay line, so any layout works
+    // up to the engine's widest: mono and stereo through 7.1.4 (12 ch), and
+    // ambisonics up to 3rd order (16 ch).
+    const auto& outputSet = layouts.getMainOutputChannelSet();
+
+    if (outputSet.isDisabled() || outputSet.size() > CombEngine<float>::maxChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -147,14 +287,166 @@ bool UniversalCombFilterAudioProcessor::isBusesLayoutSupported (const BusesLayou
 #endif
 
 void UniversalCombFilterAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processWithEngine(buffer, floatEngine, floatBank);
+}
+
+void UniversalCombFilterAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processWithEngine(buffer, doubleEngine, doubleBank);
+}
+
+bool UniversalCombFilterAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+CombParameters UniversalCombFilterAudioProcessor::getCurrentParameters() const
+{
+    CombParameters params;
+    params.delay = delay->get();
+    params.sweepWidth = sweepWidth->get();
+    params.lfoFreq = lfoFreq->get();
+    params.bleed = bleed->get();
+    params.feedforward = feedforward->get();
+    params.feedback = feedback->get();
+    params.tremolo = tremolo->get();
+    params.interpolation = (InterpolationQuality)interpolation->getIndex();
+    params.oversampling = (OversamplingMode)oversampling->getIndex();
+    params.spreadVoices(voices->get(), voiceSpread->get());
+    
+    const float maxDelays[] = { 0.05f, 0.1f, 0.25f, 0.55f };
+    params.maxDelay = maxDelays[maxDelay->getIndex()];
+    return params;
+}
+
+CombBankParameters UniversalCombFilterAudioProcessor::getBankParameters() const
+{
+    return makeCombBank((CombBankLayout)bankLayout->getIndex(), bankSize->get(), bankDecay->get(), bankMix->get());
+}
+
+CombParameters UniversalCombFilterAudioProcessor::getBlockParameters (int numSamples)
+{
+    CombParameters params = getCurrentParameters();
+    
+    // pick up a program change if one is waiting. Never blocks: if the slot is
+    // still being written it's left for the next block
+    int state = slotReady;
+    if (programSlotState.compare_exchange_strong(state, slotReading, std::memory_order_acquire)) {
+        // morph from wherever the sound is now: the last block's values, which
+        // may be part-way through an earlier morph
+        morphFrom = lastBlockParameters;
+        morphTo = pendingProgram;
+        morphLength = jmax((juce::int64)1, (juce::int64)(pendingMorphSeconds*getSampleRate()));
+        morphGeneration = pendingGeneration;
+        programSlotState.store(slotFree, std::memory_order_release);
+        
+        morphPosition = 0;
+        morphing = true;
+    }
+    
+    // while morphing, each block ends a little further along the way and the
+    // engine's ramps fill in the rest. Quality settings still come from the
+    // parameters. Once the morph is over and the parameters have all been
+    // updated, they take over again. A newer change still on its way to the
+    // slot may already be in some of the parameters, so until it arrives the
+    // last block's values carry on
+    if (morphing) {
+        morphPosition = jmin(morphPosition + numSamples, morphLength);
+        morphCombParameters(params, morphFrom, morphTo, (float)((double)morphPosition/(double)morphLength));
+        
+        if (morphPosition >= morphLength && parametersWrittenGeneration.load(std::memory_order_acquire) >= morphGeneration)
+            morphing = false;
+    } else if (programGeneration.load(std::memory_order_acquire) != morphGeneration) {
+        params = lastBlockParameters;
+    }
+    
+    lastBlockParameters = params;
+    return params;
+}
+
+template <typename SampleType>
+void UniversalCombFilterAudioProcessor::measureLevels (const juce::AudioBuffer<SampleType>& buffer, int numChannels, float& peak, double& sumOfSquares)
+{
+    const int numSamples = buffer.getNumSamples();
+    
+    for (int channel = 0; channel < numChannels; ++channel) {
+        peak = jmax(peak, (float)buffer.getMagnitude(channel, 0, numSamples));
+        const double rms = (double)buffer.getRMSLevel(channel, 0, numSamples);
+        sumOfSquares += rms*rms*numSamples/jmax(1, numChannels);
+    }
+}
+
+void UniversalCombFilterAudioProcessor::pushTelemetry (int numSamples, float delaySeconds, float lfo)
+{
+    numTelemetrySamples += numSamples;
+    
+    if (numTelemetrySamples < (int)(telemetryInterval*getSampleRate()))
+        return;
+    
+    pendingTelemetry.delaySeconds = delaySeconds;
+    pendingTelemetry.lfo = lfo;
+    pendingTelemetry.inputRms = (float)std::sqrt(inputSumOfSquares/numTelemetrySamples);
+    pendingTelemetry.outputRms = (float)std::sqrt(outputSumOfSquares/numTelemetrySamples);
+    
+    int start1, size1, start2, size2;
+    telemetryFifo.prepareToWrite(1, start1, size1, start2, size2);
+    
+    if (size1 > 0) {
+        telemetryFrames[start1] = pendingTelemetry;
+        telemetryFifo.finishedWrite(1);
+    }
+    
+    pendingTelemetry = {};
+    inputSumOfSquares = outputSumOfSquares = 0.0;
+    numTelemetrySamples = 0;
+}
+
+bool UniversalCombFilterAudioProcessor::popTelemetry (TelemetryFrame& frame)
+{
+    int start1, size1, start2, size2;
+    telemetryFifo.prepareToRead(1, start1, size1, start2, size2);
+    
+    if (size1 == 0)
+        return false;
+    
+    frame = telemetryFrames[start1];
+    telemetryFifo.finishedRead(1);
+    return true;
+}
+
+void UniversalCombFilterAudioProcessor::timerCallback()
+{
+    // the audio thread never allocates: a larger maximum delay is only asked
+    // for there, and the new delay line is built here and picked up by the
+    // next block
+    if (floatEngine.needsGrowing())
+        floatEngine.growDelayLine();
+    
+    if (doubleEngine.needsGrowing())
+        doubleEngine.growDelayLine();
+    
+    prepareBankIfNeeded();
+    publishQueuedProgram();
+    
+    // the latency only depends on the oversampling mode (auto pads the lower
+    // factors to match the highest), and the host hears about a new one from
+    // here rather than from the audio thread
+    const auto mode = (OversamplingMode)oversampling->getIndex();
+    const int latency = isUsingDoublePrecision() ? doubleEngine.getLatencySamples(mode) : floatEngine.getLatencySamples(mode);
+    
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+}
+
+template <typename SampleType>
+void UniversalCombFilterAudioProcessor::processWithEngine (juce::AudioBuffer<SampleType>& buffer, CombEngine<SampleType>& engine, CombBank<SampleType>& bank)
 {
     juce::ScopedNoDenormals noDenormals;
     const auto totalNumInputChannels  = getTotalNumInputChannels();
     const auto totalNumOutputChannels = getTotalNumOutputChannels();
     const int numSamples = buffer.getNumSamples();
-    float dpr, ph;
-    double currentDelay;
-    int dpw;
+    const BlockProfiler::ScopedTimer profilerTimer(profiler, numSamples, getSampleRate());
     
     
     // In case we have more outputs than inputs, this code clears any output
@@ -167,80 +459,37 @@ void UniversalCombFilterAudioProcessor::processBlock (juce::AudioBuffer<float>&
         buffer.clear (i, 0, numSamples);
     
     
-    // This is the place where you'd normally do the guts of your plugin's
-    // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    // Alternatively, you can process the samples with the channels
-    // interleaved by keeping the same state.
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-    {
-        auto* channelData = buffer.getWritePointer(channel);
-        auto* delayData = delayBuffer.getWritePointer(jmin(channel, delayBuffer.getNumChannels()-1));
-
-        dpw = delayWrite;
-        ph = lfoPhase;
-        
-        for (int sample = 0; sample < numSamples; ++sample)
-        {
-            const float in = channelData[sample];
-            float interpolated = 0.0f;
-            float out = 0.0f;
-            float lfo = 0.5f + 0.5f*sinf(2.0f*M_PI*ph);
-            
-            // computing M[n]
-            currentDelay = (float)*delay + *sweepWidth*lfo;
-            
-            dpr = fmodf((float)dpw - (float)(currentDelay*getSampleRate()) + (float)delayBufferLength - 3.0f, (float)delayBufferLength);
-            
-            // linear interpolation
-            float frac = dpr - floorf(dpr);
-            int prev = (int)floorf(dpr);
-            int next = (prev + 1) % delayBufferLength;
-            interpolated = (1.0f-frac)*delayData[prev] + frac*delayData[next];
-            
-            /*
-            // cubic interpolation
-            int prev1 = floorf(dpr);                                            // n
-            int prev2 = (prev1 - 1 + delayBufferLength) % delayBufferLength;    // n - 1
-            int next1 = (prev1 + 1) % delayBufferLength;                        // n + 1
-            int next2 = (next1 + 1) % delayBufferLength;                        // n + 2
-            
-            float frac = dpr - prev1;
-            float frac2 = frac*frac;
-            float frac3 = frac2*frac;
-            
-            float c0 = delayData[prev1];
-            float c1 = delayData[next1] - delayData[prev1];
-            float c2 = delayData[prev2] - delayData[prev1];
-            float c3 = delayData[prev1] - delayData[prev2] - delayData[next1] + delayData[next2];
-            
-            interpolated = c3*frac3 + c2*frac2 + c1*frac + c0;
-            */
-            
-            float xh = in + *feedback*interpolated;         // xh[n] = x[n] + fb*xh[n-M]
-            out = *bleed*xh + *feedforward*interpolated;    // y[n] = bl*xh[n] + ff*xh[n-M]
-            delayData[dpw] = xh;
-        
-            // apply tremolo if toggled
-            *tremolo ? channelData[sample] = lfo*out : channelData[sample] = out;
-            
-            // increment write pointer, loop if necessary
-            dpw = (dpw + 1) % delayBufferLength;
-            
-            // increment LFO phase by Ts = 1/fs
-            if (*lfoFreq == 0 && ph > 0.01) {
-                // resets phase after frequency is set to 0. maybe this should be a toggle on/off instead?
-                ph = fmodf(ph + 0.05*samplePeriod, 1.0f);
-            } else if (*lfoFreq != 0) {
-                ph = fmodf(ph + *lfoFreq*samplePeriod, 1.0f);
-            }
+    // JUCE hands over each parameter's latest value before every block but not
+    // the sample offsets of the host's automation points, and for automation
+    // that value is normally where the curve is at the end of the block. So
+    // it's passed as a change at the last sample: the engine ramps to it across
+    // the whole block, and automation comes out as straight lines between
+    // blocks rather than steps the size of the buffer. Once its input and
+    // feedback tail are both silent the engine idles until the input comes back
+    const CombParameterChange change { numSamples, getBlockParameters(numSamples) };
+    const bool measuring = telemetryEnabled.load(std::memory_order_relaxed);
+    
+    if (measuring)
+        measureLevels(buffer, totalNumInputChannels, pendingTelemetry.inputPeak, inputSumOfSquares);
+    
+    engine.process(buffer.getArrayOfWritePointers(), totalNumInputChannels, numSamples, &change, 1);
+    
+    // the bank follows the engine when it's on, starting from silence each time
+    // it's switched on or to another layout. Either hands it to the timer to
+    // clear, and it comes on once that's done
+    if (bankState.load(std::memory_order_acquire) == bankReady) {
+        if (bankLayout->getIndex() != readyBankLayout) {
+            bankState.store(bankStale, std::memory_order_release);
+        } else {
+            bank.setParameters(getBankParameters());
+            bank.process(buffer.getArrayOfWritePointers(), totalNumInputChannels, numSamples);
         }
     }
     
-    // update permanent variables
-    delayWrite = dpw;
-    lfoPhase = ph;
+    if (measuring) {
+        measureLevels(buffer, totalNumInputChannels, pendingTelemetry.outputPeak, outputSumOfSquares);
+        pushTelemetry(numSamples, (float)engine.getCurrentDelaySeconds(), engine.getLfoValue());
+    }
 }
 
 //==============================================================================
@@ -255,17 +504,70 @@ juce::AudioProcessorEditor* UniversalCombFilterAudioProcessor::createEditor()
 }
 
 //==============================================================================
+// State layout (little-endian): magic, version, current program, number of
+// parameters, then each parameter's ID (null-terminated UTF-8) and normalised
+// value (float). Parameters are matched up by ID, so states saved before a
+// parameter was added or after one was removed still load.
+static const int stateMagic = 0x53464355;    // "UCFS"
+static const int stateVersion = 1;
+
 void UniversalCombFilterAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    MemoryOutputStream stream(destData, false);
+    const auto& params = getParameters();
+    
+    stream.writeInt(stateMagic);
+    stream.writeInt(stateVersion);
+    stream.writeInt(currentProgram);
+    stream.writeInt(params.size());
+    
+    for (auto* param : params) {
+        auto* withID = dynamic_cast<AudioProcessorParameterWithID*>(param);
+        stream.writeString(withID != nullptr ? withID->paramID : String());
+        stream.writeFloat(param->getValue());
+    }
 }
 
 void UniversalCombFilterAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    MemoryInputStream stream(data, (size_t)sizeInBytes, false);
+    
+    if (sizeInBytes < 16 || stream.readInt() != stateMagic)
+        return;
+    
+    // a layout this build doesn't know can't be read as version 1
+    const int version = stream.readInt();
+    
+    if (version < 1 || version > stateVersion)
+        return;
+    
+    const int program = stream.readInt();
+    const int numSaved = stream.readInt();
+    
+    for (int i = 0; i < numSaved && ! stream.isExhausted(); ++i) {
+        const String paramID = stream.readString();
+        const float value = stream.readFloat();
+        
+        for (auto* param : getParameters())
+            if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*>(param))
+                if (withID->paramID == paramID)
+                    param->setValueNotifyingHost(jlimit(0.0f, 1.0f, value));
+    }
+    
+    if (isPositiveAndBelow(program, numCombPresets))
+        currentProgram = program;
+    
+    // a longer maximum delay is allocated here rather than left for the timer,
+    // which offline renders and some hosts' state loading never give a chance
+    // to run before the audio thread needs it
+    if (getSampleRate() > 0.0) {
+        const double maxDelaySeconds = getCurrentParameters().maxDelay;
+        
+        if (isUsingDoublePrecision())
+            doubleEngine.reserveDelay(maxDelaySeconds);
+        else
+            floatEngine.reserveDelay(maxDelaySeconds);
+    }
 }
 
 //==============================================================================
@@ -9,11 +9,17 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <atomic>
+#include "BlockProfiler.h"
+#include "CombBank.h"
+#include "CombEngine.h"
+#include "CombPresets.h"
 
 //==============================================================================
 /**
 */
-class UniversalCombFilterAudioProcessor  : public juce::AudioProcessor
+class UniversalCombFilterAudioProcessor  : public juce::AudioProcessor,
+                                           private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -32,6 +38,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -56,12 +64,58 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    //==============================================================================
+    /** A summary of what the kernel did over a few milliseconds of audio, for the
+        editor: where the read head was, the LFO, and input and output levels.
+    */
+    struct TelemetryFrame
+    {
+        float delaySeconds = 0.0f, lfo = 0.0f;
+        float inputPeak = 0.0f, inputRms = 0.0f, outputPeak = 0.0f, outputRms = 0.0f;
+    };
+    
+    /** Telemetry is only measured while something is reading it. */
+    void setTelemetryEnabled(bool shouldBeEnabled) { telemetryEnabled = shouldBeEnabled; }
+    
+    /** Takes the oldest frame waiting. Call from one thread only (the editor's). */
+    bool popTelemetry(TelemetryFrame&);
+    
+    /** Timing of every processBlock call, when built with COMB_PROFILING. */
+    BlockProfiler& getProfiler() { return profiler; }
+
 
 private:
     //==============================================================================
-    juce::AudioBuffer<float> delayBuffer;
-    int delayBufferLength, delayWrite;
-    float samplePeriod, lfoPhase;
+    CombParameters getCurrentParameters() const;
+    CombBankParameters getBankParameters() const;
+    CombParameters getBlockParameters (int numSamples);
+    
+    template <typename SampleType>
+    void measureLevels (const juce::AudioBuffer<SampleType>&, int numChannels, float& peak, double& sumOfSquares);
+    void pushTelemetry (int numSamples, float delaySeconds, float lfo);
+    void timerCallback() override;
+    void prepareBankIfNeeded();
+    void publishQueuedProgram();
+    
+    template <typename SampleType>
+    void processWithEngine (juce::AudioBuffer<SampleType>&, CombEngine<SampleType>&, CombBank<SampleType>&);
+    
+    // only the engine and bank matching the host's processing precision are prepared
+    CombEngine<float> floatEngine;
+    CombEngine<double> doubleEngine;
+    CombBank<float> floatBank;
+    CombBank<double> doubleBank;
+    
+    // The bank is only allocated once a layout is selected, and is cleared off
+    // the audio thread. It belongs to the audio thread while bankReady, for
+    // the layout in readyBankLayout, and the audio thread hands it back as
+    // bankStale when it's switched off or to another layout, to be cleared
+    // (and allocated the first time) before it can come on again
+    enum BankState { bankStale, bankReady };
+    std::atomic<int> bankState { bankStale };
+    juce::CriticalSection bankLock;
+    double bankSampleRate = 0.0;
+    int bankNumChannels = 1, readyBankLayout = 0;
     
     juce::AudioParameterFloat* sweepWidth;
     juce::AudioParameterFloat* lfoFreq;
@@ -70,6 +124,59 @@ private:
     juce::AudioParameterFloat* feedback;
     juce::AudioParameterFloat* delay;
     juce::AudioParameterBool* tremolo;
+    juce::AudioParameterChoice* interpolation;
+    juce::AudioParameterChoice* oversampling;
+    juce::AudioParameterChoice* maxDelay;
+    juce::AudioParameterFloat* morphTime;
+    juce::AudioParameterInt* voices;
+    juce::AudioParameterFloat* voiceSpread;
+    juce::AudioParameterChoice* bankLayout;
+    juce::AudioParameterFloat* bankSize;
+    juce::AudioParameterFloat* bankDecay;
+    juce::AudioParameterFloat* bankMix;
+    
+    // Program changes are handed to the audio thread as a whole through a
+    // single slot, so it never sees a mix of old and new values while the
+    // parameters are being updated one by one. The slot belongs to whoever
+    // moved it to writing or reading. Writers never wait for it: a change the
+    // audio thread is in the way of stays queued for the timer to try again,
+    // and meanwhile programGeneration running ahead of the last one received
+    // tells the audio thread to hold still.
+    enum ProgramSlotState { slotFree, slotWriting, slotReady, slotReading };
+    std::atomic<int> programSlotState { slotFree };
+    CombParameters pendingProgram;
+    float pendingMorphSeconds = 0.0f;
+    int pendingGeneration = 0;
+    
+    // writers only, under programLock: the latest change, until it's in the slot
+    juce::CriticalSection programLock;
+    CombParameters queuedProgram;
+    float queuedMorphSeconds = 0.0f;
+    int queuedGeneration = 0, publishedGeneration = 0;
+    
+    std::atomic<int> currentProgram { 0 };
+    std::atomic<int> programGeneration { 0 }, parametersWrittenGeneration { 0 };
+    
+    // audio thread -> editor, one frame per telemetryInterval seconds. When
+    // the editor falls behind, new frames are dropped rather than waited for
+    static constexpr double telemetryInterval = 0.008;
+    static constexpr int telemetryFifoSize = 64;
+    std::atomic<bool> telemetryEnabled { false };
+    juce::AbstractFifo telemetryFifo { telemetryFifoSize };
+    TelemetryFrame telemetryFrames[telemetryFifoSize];
+    
+    // audio thread only: levels gathered since the last frame
+    TelemetryFrame pendingTelemetry;
+    double inputSumOfSquares = 0.0, outputSumOfSquares = 0.0;
+    int numTelemetrySamples = 0;
+    
+    BlockProfiler profiler;
+    
+    // audio thread only: the morph in progress, if any
+    CombParameters morphFrom, morphTo, lastBlockParameters;
+    juce::int64 morphLength = 0, morphPosition = 0;
+    int morphGeneration = 0;
+    bool morphing = false;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UniversalCombFilterAudioProcessor)
 };
@@ -0,0 +1,402 @@
+/*
+  ==============================================================================
+
+    Offline batch renderer for CombEngine.
+
+    Streams audio files through the comb filter a block at a time and writes
+    the results next to them (or into --out), rendering several files at once
+    on a pool of worker threads, each with its own engine. Runs headless: no
+    audio device or message loop is needed.
+
+    usage: CombRender [options] <files or folders...>
+
+      --preset name          flanger, vibrato, ringmod, chorus or echo (default flanger)
+      --interpolation name   linear, cubic, allpass or sinc (default linear)
+      --oversampling name    off, 2x, 4x or auto (default auto)
+      --format ext           wav, flac or aiff (default: same as the input)
+      --out folder           where to write the results (default: beside the inputs)
+      --threads n            number of files to render at once (default: one per core)
+      --block n              samples per block (default 4096)
+      --tail                 keep rendering after the input ends until the feedback
+                             tail has died away (at most 30 s)
+
+    Folders are searched recursively for .wav, .flac, .aif and .aiff files,
+    leaving out earlier results. Each result is named after its input with a
+    "_comb" suffix. Under --out, files found in a folder keep their path
+    relative to it, so stems with the same name in different subfolders don't
+    overwrite each other; if two results would still land on the same file,
+    nothing is rendered. A per-file line is printed as each one finishes,
+    followed by the aggregate realtime factor (seconds of audio rendered per
+    second of wall-clock time).
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "../../../Source/CombEngine.h"
+#include "../../../Source/CombPresets.h"
+
+static bool getPreset (const char* name, CombParameters& params)
+{
+    if (auto* preset = findCombPreset (name))
+    {
+        preset->applyTo (params);
+        return true;
+    }
+
+    return false;
+}
+
+static bool getInterpolation (const char* name, CombParameters& params)
+{
+    const char* names[] = { "linear", "cubic", "allpass", "sinc" };
+
+    for (int i = 0; i < (int) InterpolationQuality::numQualities; ++i)
+    {
+        if (std::strcmp (name, names[i]) == 0)
+        {
+            params.interpolation = (InterpolationQuality) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool getOversampling (const char* name, CombParameters& params)
+{
+    const char* names[] = { "off", "2x", "4x", "auto" };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (std::strcmp (name, names[i]) == 0)
+        {
+            params.oversampling = (OversamplingMode) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct RenderSettings
+{
+    CombParameters params;
+    juce::String format;        // output file extension, or empty to match the input
+    juce::File outputFolder;    // or a non-existent File to write beside the inputs
+    int blockSize = 4096;
+    bool renderTail = false;
+};
+
+static constexpr double maxTailSeconds = 30.0;
+static const char* const audioFileWildcard = "*.wav;*.flac;*.aif;*.aiff";
+
+/** An input file and the folder its output path is made relative to: the
+    folder argument it was found in, or its own folder if it was named directly.
+*/
+struct InputFile
+{
+    juce::File file, root;
+};
+
+static juce::File getOutputFile (const InputFile& input, const RenderSettings& settings)
+{
+    const auto extension = settings.format.isNotEmpty() ? settings.format : input.file.getFileExtension().substring (1);
+    auto folder = input.file.getParentDirectory();
+
+    if (settings.outputFolder != juce::File())
+        folder = folder.isAChildOf (input.root) ? settings.outputFolder.getChildFile (folder.getRelativePathFrom (input.root))
+                                                : settings.outputFolder;
+
+    return folder.getChildFile (input.file.getFileNameWithoutExtension() + "_comb." + extension);
+}
+
+/** Key for comparing paths the way the file system does. */
+static juce::String getPathKey (const juce::File& file)
+{
+    const auto path = file.getFullPathName();
+    return juce::File::areFileNamesCaseSensitive() ? path : path.toLowerCase();
+}
+
+//==============================================================================
+/**
+    Renders one file. Everything it uses (format readers and writers, engine,
+    block buffer) belongs to the job, so jobs can run on any number of threads
+    at once.
+*/
+class RenderJob  : public juce::ThreadPoolJob
+{
+public:
+    RenderJob (const juce::File& inputFile, const juce::File& outputFile, const RenderSettings& s, std::mutex& printLock)
+        : juce::ThreadPoolJob (inputFile.getFileName()), input (inputFile), output (outputFile), settings (s), outputLock (printLock)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        error = render();
+        wallSeconds = (juce::Time::getMillisecondCounterHiRes() - start)*0.001;
+
+        const std::lock_guard<std::mutex> lock (outputLock);
+
+        if (error.isNotEmpty())
+            std::fprintf (stderr, "%s: %s\n", input.getFullPathName().toRawUTF8(), error.toRawUTF8());
+        else
+            std::printf ("%s: %.1f s of audio in %.2f s, %.1fx realtime\n", output.getFullPathName().toRawUTF8(),
+                         audioSeconds, wallSeconds, audioSeconds/juce::jmax (wallSeconds, 1.0e-9));
+
+        std::fflush (stdout);
+        return jobHasFinished;
+    }
+
+    bool failed() const noexcept               { return error.isNotEmpty(); }
+    double getAudioSeconds() const noexcept    { return audioSeconds; }
+
+private:
+    juce::String render()
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (input));
+
+        if (reader == nullptr)
+            return "not a readable audio file";
+
+        const auto extension = output.getFileExtension().substring (1);
+        auto* format = formats.findFormatForFileExtension (extension);
+
+        if (format == nullptr)
+            return "can't write ." + extension + " files";
+
+        // keep the input's bit depth if the output format has it, or else use the deepest one it has
+        const auto bitDepths = format->getPossibleBitDepths();
+        int bitsPerSample = (int) reader->bitsPerSample;
+
+        if (! bitDepths.contains (bitsPerSample))
+            bitsPerSample = bitDepths.isEmpty() ? 16 : bitDepths[bitDepths.size() - 1];
+
+        const int numChannels = (int) reader->numChannels;
+        const double sampleRate = reader->sampleRate;
+
+        output.deleteFile();
+        auto stream = std::make_unique<juce::FileOutputStream> (output);
+
+        if (stream->failedToOpen())
+            return "can't create " + output.getFullPathName();
+
+        std::unique_ptr<juce::AudioFormatWriter> writer (format->createWriterFor (stream.get(), sampleRate, (unsigned int) numChannels,
+                                                                                  bitsPerSample, reader->metadataValues, 0));
+
+        if (writer == nullptr)
+            return "can't write " + juce::String (numChannels) + " channels at " + juce::String (sampleRate) + " Hz as ." + extension;
+
+        stream.release();   // the writer owns it now
+
+        const int blockSize = juce::jmax (1, settings.blockSize);
+        juce::AudioBuffer<float> buffer (numChannels, blockSize);
+
+        // the latency only depends on the oversampling mode: in auto mode the
+        // engine pads lower factors out to the highest one's
+        CombEngine<float> engine;
+        engine.setParameters (settings.params);
+        engine.prepare (sampleRate, numChannels, blockSize);
+
+        const juce::int64 latency = engine.getLatencySamples();
+        juce::int64 tailSamples = 0;
+
+        if (settings.renderTail)
+            tailSamples = (juce::int64) (juce::jmin (CombEngine<float>::getTailLengthSeconds (settings.params, sampleRate), maxTailSeconds)*sampleRate);
+
+        // the first latency samples out of the engine are the filters' delay,
+        // and are dropped; the input is padded with silence to make up for them
+        const juce::int64 inputLength = reader->lengthInSamples;
+        const juce::int64 totalSamples = inputLength + tailSamples + latency;
+
+        for (juce::int64 position = 0; position < totalSamples;)
+        {
+            const int numSamples = (int) juce::jmin ((juce::int64) blockSize, totalSamples - position);
+            const int numFromInput = (int) juce::jlimit ((juce::int64) 0, (juce::int64) numSamples, inputLength - position);
+
+            if (numFromInput > 0)
+                reader->read (&buffer, 0, numFromInput, position, true, true);
+
+            if (numFromInput < numSamples)
+                buffer.clear (numFromInput, numSamples - numFromInput);
+
+            engine.process (buffer.getArrayOfWritePointers(), numChannels, numSamples);
+
+            const int numToSkip = (int) juce::jlimit ((juce::int64) 0, (juce::int64) numSamples, latency - position);
+
+            if (numToSkip < numSamples && ! writer->writeFromAudioSampleBuffer (buffer, numToSkip, numSamples - numToSkip))
+                return "write failed: " + output.getFullPathName();
+
+            position += numSamples;
+        }
+
+        audioSeconds = (double) (totalSamples - latency)/sampleRate;
+        return {};
+    }
+
+    juce::File input, output;
+    const RenderSettings& settings;
+    std::mutex& outputLock;
+    juce::String error;
+    double audioSeconds = 0.0, wallSeconds = 0.0;
+};
+
+//==============================================================================
+static int printUsage (const char* programName)
+{
+    std::fprintf (stderr, "usage: %s [--preset flanger|vibrato|ringmod|chorus|echo] [--interpolation linear|cubic|allpass|sinc]\n"
+                          "       [--oversampling off|2x|4x|auto] [--format wav|flac|aiff] [--out folder] [--threads n]\n"
+                          "       [--block n] [--tail] <files or folders...>\n", programName);
+    return 1;
+}
+
+int main (int argc, char* argv[])
+{
+    RenderSettings settings;
+    settings.params.oversampling = OversamplingMode::automatic;
+    getPreset ("flanger", settings.params);
+
+    int numThreads = juce::SystemStats::getNumCpus();
+    std::vector<InputFile> inputs;
+    std::set<juce::String> inputPaths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const juce::String arg (argv[i]);
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+
+        if (arg == "--tail")
+        {
+            settings.renderTail = true;
+            continue;
+        }
+
+        if (arg.startsWith ("--"))
+        {
+            if (i + 1 >= argc)
+                return printUsage (argv[0]);
+
+            ++i;
+
+            if (arg == "--preset")                  { if (! getPreset (value, settings.params)) return printUsage (argv[0]); }
+            else if (arg == "--interpolation")      { if (! getInterpolation (value, settings.params)) return printUsage (argv[0]); }
+            else if (arg == "--oversampling")       { if (! getOversampling (value, settings.params)) return printUsage (argv[0]); }
+            else if (arg == "--format")             settings.format = juce::String (value).trimCharactersAtStart (".").toLowerCase();
+            else if (arg == "--out")                settings.outputFolder = juce::File::getCurrentWorkingDirectory().getChildFile (value);
+            else if (arg == "--threads")            numThreads = std::atoi (value);
+            else if (arg == "--block")              settings.blockSize = std::atoi (value);
+            else                                    return printUsage (argv[0]);
+
+            continue;
+        }
+
+        const auto file = juce::File::getCurrentWorkingDirectory().getChildFile (arg);
+
+        if (file.isDirectory())
+        {
+            // skip anything rendered by an earlier run, and files already listed (a file
+            // named directly and again through its folder is only rendered once)
+            for (auto& child : file.findChildFiles (juce::File::findFiles, true, audioFileWildcard))
+                if (! child.getFileNameWithoutExtension().endsWith ("_comb") && inputPaths.insert (getPathKey (child)).second)
+                    inputs.push_back ({ child, file });
+        }
+        else if (file.existsAsFile())
+        {
+            if (inputPaths.insert (getPathKey (file)).second)
+                inputs.push_back ({ file, file.getParentDirectory() });
+        }
+        else
+            std::fprintf (stderr, "%s: no such file or folder\n", arg.toRawUTF8());
+    }
+
+    if (inputs.empty() || numThreads <= 0 || settings.blockSize <= 0)
+        return printUsage (argv[0]);
+
+    // jobs run at once, so two of them writing one file (or one overwriting
+    // another's input) would lose a result without either reporting it
+    std::map<juce::String, juce::File> outputPaths;   // to the input writing each
+    std::vector<juce::File> outputs;
+
+    for (auto& input : inputs)
+    {
+        const auto output = getOutputFile (input, settings);
+        const auto key = getPathKey (output);
+
+        if (inputPaths.count (key) > 0)
+        {
+            std::fprintf (stderr, "%s would overwrite the input %s; nothing was rendered\n",
+                          input.file.getFullPathName().toRawUTF8(), output.getFullPathName().toRawUTF8());
+            return 1;
+        }
+
+        const auto claim = outputPaths.emplace (key, input.file);
+
+        if (! claim.second)
+        {
+            std::fprintf (stderr, "%s and %s would both write %s; nothing was rendered\n",
+                          claim.first->second.getFullPathName().toRawUTF8(), input.file.getFullPathName().toRawUTF8(),
+                          output.getFullPathName().toRawUTF8());
+            return 1;
+        }
+
+        outputs.push_back (output);
+    }
+
+    // folders are made here rather than by the jobs, which would race to make shared parents
+    for (auto& output : outputs)
+    {
+        if (! output.getParentDirectory().createDirectory())
+        {
+            std::fprintf (stderr, "can't create %s\n", output.getParentDirectory().getFullPathName().toRawUTF8());
+            return 1;
+        }
+    }
+
+    std::mutex printLock;
+    std::vector<std::unique_ptr<RenderJob>> jobs;
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+
+    {
+        juce::ThreadPool pool (juce::jmin (numThreads, (int) inputs.size()));
+
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            jobs.push_back (std::make_unique<RenderJob> (inputs[i].file, outputs[i], settings, printLock));
+            pool.addJob (jobs.back().get(), false);
+        }
+
+        for (auto& job : jobs)
+            pool.waitForJobToFinish (job.get(), -1);
+    }
+
+    const double wallSeconds = (juce::Time::getMillisecondCounterHiRes() - start)*0.001;
+    double audioSeconds = 0.0;
+    int numFailed = 0;
+
+    for (auto& job : jobs)
+    {
+        audioSeconds += job->getAudioSeconds();
+        numFailed += job->failed() ? 1 : 0;
+    }
+
+    std::printf ("%d files (%d failed), %.1f s of audio in %.2f s on %d threads, %.1fx realtime\n",
+                 (int) jobs.size(), numFailed, audioSeconds, wallSeconds, juce::jmin (numThreads, (int) inputs.size()),
+                 audioSeconds/juce::jmax (wallSeconds, 1.0e-9));
+
+    return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+  ==============================================================================
+
+    Offline throughput benchmark for CombEngine.
+
+    Pushes synthetic audio through the comb kernel and reports samples/sec and
+    ns/sample, so the hot loop can be profiled outside of a DAW.
+
+    usage: CombBenchmark [seconds] [blockSize] [numChannels] [sampleRate] [preset] [interpolation] [oversampling] [precision]
+
+    where preset is one of the README presets (flanger, vibrato, ringmod,
+    chorus) or echo, a long delay with feedback, interpolation is one of
+    linear, cubic, allpass or sinc, oversampling is one of off, 2x, 4x or
+    auto, and precision is float or double.
+
+  ==============================================================================
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../../../Source/CombEngine.h"
+#include "../../../Source/CombPresets.h"
+
+static bool getPreset (const char* name, CombParameters& params)
+{
+    if (auto* preset = findCombPreset (name))
+    {
+        preset->applyTo (params);
+        return true;
+    }
+
+    return false;
+}
+
+static bool getInterpolation (const char* name, CombParameters& params)
+{
+    const char* names[] = { "linear", "cubic", "allpass", "sinc" };
+
+    for (int i = 0; i < (int) InterpolationQuality::numQualities; ++i)
+    {
+        if (std::strcmp (name, names[i]) == 0)
+        {
+            params.interpolation = (InterpolationQuality) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool getOversampling (const char* name, CombParameters& params)
+{
+    const char* names[] = { "off", "2x", "4x", "auto" };
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (std::strcmp (name, names[i]) == 0)
+        {
+            params.oversampling = (OversamplingMode) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+struct BenchmarkSettings
+{
+    double seconds, sampleRate;
+    int blockSize, numChannels;
+    const char* presetName;
+    const char* interpolationName;
+    CombParameters params;
+};
+
+template <typename SampleType>
+static void runBenchmark (const BenchmarkSettings& settings, const char* precisionName)
+{
+    const int blockSize = settings.blockSize;
+    const int numChannels = settings.numChannels;
+    const double sampleRate = settings.sampleRate;
+
+    CombEngine<SampleType> engine;
+    engine.prepare (sampleRate, numChannels, blockSize);
+    engine.setParameters (settings.params);
+
+    // white noise source, regenerated into the block buffer before each call
+    // since the engine works in place
+    const int sourceLength = 1 << 16;
+    std::vector<SampleType> source ((size_t) sourceLength);
+    std::mt19937 rng (1234);
+    std::uniform_real_distribution<float> dist (-0.5f, 0.5f);
+    for (auto& s : source)
+        s = (SampleType) dist (rng);
+
+    std::vector<std::vector<SampleType>> block ((size_t) numChannels, std::vector<SampleType> ((size_t) blockSize));
+    std::vector<SampleType*> channels;
+    for (auto& ch : block)
+        channels.push_back (ch.data());
+
+    const long long totalBlocks = (long long) (settings.seconds*sampleRate/blockSize) + 1;
+    int readPos = 0;
+    double checksum = 0.0, kernelNs = 0.0;
+
+    for (long long b = 0; b < totalBlocks; ++b)
+    {
+        for (auto& ch : block)
+            for (int i = 0; i < blockSize; ++i)
+                ch[(size_t) i] = source[(size_t) ((readPos + i) & (sourceLength - 1))];
+
+        readPos = (readPos + blockSize) & (sourceLength - 1);
+
+        const auto start = std::chrono::steady_clock::now();
+        engine.process (channels.data(), numChannels, blockSize);
+        const auto end = std::chrono::steady_clock::now();
+
+        kernelNs += (double) std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count();
+        checksum += (double) block[0][0];
+    }
+
+    const double samplesProcessed = (double) totalBlocks*blockSize*numChannels;
+    const double audioSeconds = (double) totalBlocks*blockSize/sampleRate;
+
+    std::printf ("CombEngine (%s, %s, %dx oversampling, %s): %d ch, %d samples/block, %.0f Hz, %.1f s of audio\n",
+                 settings.presetName, settings.interpolationName, engine.getOversamplingFactor(), precisionName,
+                 numChannels, blockSize, sampleRate, audioSeconds);
+    std::printf ("  %.3f Msamples/sec\n", samplesProcessed/kernelNs*1.0e3);
+    std::printf ("  %.3f ns/sample\n", kernelNs/samplesProcessed);
+    std::printf ("  %.1fx realtime\n", audioSeconds*1.0e9/kernelNs);
+    std::printf ("  (checksum %g)\n", checksum);
+}
+
+int main (int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    settings.seconds           = argc > 1 ? std::atof (argv[1]) : 10.0;
+    settings.blockSize         = argc > 2 ? std::atoi (argv[2]) : 512;
+    settings.numChannels       = argc > 3 ? std::atoi (argv[3]) : 2;
+    settings.sampleRate        = argc > 4 ? std::atof (argv[4]) : 48000.0;
+    settings.presetName        = argc > 5 ? argv[5] : "flanger";
+    settings.interpolationName = argc > 6 ? argv[6] : "linear";
+    const char* oversamplingName = argc > 7 ? argv[7] : "off";
+    const char* precisionName    = argc > 8 ? argv[8] : "float";
+    const bool isDouble = std::strcmp (precisionName, "double") == 0;
+
+    if (settings.seconds <= 0.0 || settings.blockSize <= 0 || settings.numChannels <= 0 || settings.sampleRate <= 0.0
+         || ! getPreset (settings.presetName, settings.params) || ! getInterpolation (settings.interpolationName, settings.params)
+         || ! getOversampling (oversamplingName, settings.params)
+         || (! isDouble && std::strcmp (precisionName, "float") != 0))
+    {
+        std::fprintf (stderr, "usage: %s [seconds] [blockSize] [numChannels] [sampleRate] [flanger|vibrato|ringmod|chorus|echo] [linear|cubic|allpass|sinc] [off|2x|4x|auto] [float|double]\n", argv[0]);
+        return 1;
+    }
+
+    if (isDouble)
+        runBenchmark<double> (settings, precisionName);
+    else
+        runBenchmark<float> (settings, precisionName);
+
+    return 0;
+}
@@ -0,0 +1,395 @@
+/*
+  ==============================================================================
+
+    Benchmark matrix for CombEngine.
+
+    Runs the comb kernel over every combination of block size, sample rate,
+    channel count and preset regime, prints ns/sample for each case and can
+    save the results as CSV or compare them against a saved baseline. The
+    reverb and resonator regimes time a CombBank instead.
+
+    usage: CombBenchmarkSuite [options]
+
+      --blocks 16,64,...        block sizes (default 16,64,256,1024,4096)
+      --rates 44100,...         sample rates (default 44100,48000,96000,192000,384000)
+      --channels 1,2,...        channel counts (default 1,2,8,16)
+      --regimes flanger,...     flanger, vibrato, ringmod, chorus, feedback, ensemble,
+                                reverb, resonator
+      --interpolation name      linear, cubic, allpass or sinc (default linear)
+      --oversampling mode       off, 2x, 4x or auto (default off)
+      --precision type          float or double (default float)
+      --time seconds            kernel time measured per repetition (default 0.02)
+      --repeats n               repetitions per case, the median is kept (default 5)
+      --quick                   a small matrix for a fast check
+      --save file.csv           writes the results
+      --baseline file.csv       compares against earlier results
+      --tolerance fraction      slowdown allowed before a case counts as a
+                                regression (default 0.1)
+
+    The exit code is 2 if any case regressed against the baseline.
+
+  ==============================================================================
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../../Source/CombBank.h"
+#include "../../../Source/CombEngine.h"
+#include "../../../Source/CombPresets.h"
+
+//==============================================================================
+struct Regime
+{
+    const char* name;
+    const char* presetID;
+    float feedback;     // overrides the preset's when not negative
+    int voices;
+    CombBankLayout bank;    // times this bank layout instead of the preset when not off
+};
+
+/** The README's presets, plus a flanger pushed close to self-oscillation and
+    the vibrato as a full ensemble of voices, and the bank's two layouts.
+*/
+static const Regime regimes[] =
+{
+    { "flanger",   "flanger", -1.0f,  1,              CombBankLayout::off },
+    { "vibrato",   "vibrato", -1.0f,  1,              CombBankLayout::off },
+    { "ringmod",   "ringmod", -1.0f,  1,              CombBankLayout::off },
+    { "chorus",    "chorus",  -1.0f,  1,              CombBankLayout::off },
+    { "feedback",  "flanger", 0.95f,  1,              CombBankLayout::off },
+    { "ensemble",  "vibrato", -1.0f,  maxCombVoices,  CombBankLayout::off },
+    { "reverb",    "flanger", -1.0f,  1,              CombBankLayout::reverb },
+    { "resonator", "flanger", -1.0f,  1,              CombBankLayout::resonator },
+};
+
+static const Regime* findRegime (const std::string& name)
+{
+    for (auto& regime : regimes)
+        if (name == regime.name)
+            return &regime;
+
+    return nullptr;
+}
+
+struct Case
+{
+    const Regime* regime;
+    int blockSize, numChannels;
+    double sampleRate;
+
+    /** Identifies the case in a results file, along with the engine settings. */
+    std::string getKey (const std::string& settings) const
+    {
+        return std::string (regime->name) + "," + std::to_string (blockSize) + "," + std::to_string ((long) sampleRate)
+                 + "," + std::to_string (numChannels) + "," + settings;
+    }
+};
+
+struct Options
+{
+    std::vector<int> blockSizes { 16, 64, 256, 1024, 4096 };
+    std::vector<double> sampleRates { 44100, 48000, 96000, 192000, 384000 };
+    std::vector<int> channelCounts { 1, 2, 8, 16 };
+    std::vector<const Regime*> regimeList;
+    std::string interpolation = "linear", oversampling = "off", precision = "float";
+    std::string savePath, baselinePath;
+    double repeatSeconds = 0.02, tolerance = 0.1;
+    int repeats = 5;
+};
+
+//==============================================================================
+template <typename Type>
+static bool parseList (const char* text, std::vector<Type>& list)
+{
+    list.clear();
+    std::stringstream stream (text);
+
+    for (std::string item; std::getline (stream, item, ',');)
+    {
+        const double value = std::atof (item.c_str());
+
+        if (value <= 0.0)
+            return false;
+
+        list.push_back ((Type) value);
+    }
+
+    return ! list.empty();
+}
+
+static bool parseRegimes (const char* text, std::vector<const Regime*>& list)
+{
+    list.clear();
+    std::stringstream stream (text);
+
+    for (std::string item; std::getline (stream, item, ',');)
+    {
+        if (auto* regime = findRegime (item))
+            list.push_back (regime);
+        else
+            return false;
+    }
+
+    return ! list.empty();
+}
+
+static int findName (const std::string& name, const std::vector<std::string>& names)
+{
+    const auto it = std::find (names.begin(), names.end(), name);
+    return it != names.end() ? (int) (it - names.begin()) : -1;
+}
+
+static const std::vector<std::string> interpolationNames { "linear", "cubic", "allpass", "sinc" };
+static const std::vector<std::string> oversamplingNames { "off", "2x", "4x", "auto" };
+
+//==============================================================================
+/** Returns the median ns per channel-sample of processing a case. */
+template <typename SampleType>
+static double measure (const Case& c, const Options& options, const std::vector<SampleType>& source)
+{
+    CombParameters params;
+    findCombPreset (c.regime->presetID)->applyTo (params);
+
+    if (c.regime->feedback >= 0.0f)
+        params.feedback = c.regime->feedback;
+
+    params.spreadVoices (c.regime->voices, 1.0f);
+    params.interpolation = (InterpolationQuality) findName (options.interpolation, interpolationNames);
+    params.oversampling = (OversamplingMode) findName (options.oversampling, oversamplingNames);
+
+    CombEngine<SampleType> engine;
+    engine.setParameters (params);
+    engine.prepare (c.sampleRate, c.numChannels, c.blockSize);
+
+    const auto bankParams = makeCombBank (c.regime->bank, 0.5f, 0.8f, 1.0f);
+    CombBank<SampleType> bank;
+    bank.setParameters (bankParams);
+    bank.prepare (c.sampleRate, c.numChannels, CombBank<SampleType>::getNumLanes (bankParams), bankParams.getMaxDelay());
+    const bool timeBank = c.regime->bank != CombBankLayout::off;
+
+    std::vector<std::vector<SampleType>> block ((size_t) c.numChannels, std::vector<SampleType> ((size_t) c.blockSize));
+    std::vector<SampleType*> channels;
+    for (auto& ch : block)
+        channels.push_back (ch.data());
+
+    const int sourceMask = (int) source.size() - 1;
+    int readPos = 0;
+
+    // the engine works in place, so the noise is copied in before every block
+    // and only the kernel itself is timed
+    auto processBlock = [&]
+    {
+        for (auto& ch : block)
+            for (int i = 0; i < c.blockSize; ++i)
+                ch[(size_t) i] = source[(size_t) ((readPos + i) & sourceMask)];
+
+        readPos = (readPos + c.blockSize) & sourceMask;
+
+        const auto start = std::chrono::steady_clock::now();
+        if (timeBank)
+            bank.process (channels.data(), c.numChannels, c.blockSize);
+        else
+            engine.process (channels.data(), c.numChannels, c.blockSize);
+
+        return std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now() - start).count();
+    };
+
+    // warm up the caches, branch predictors and the delay line's contents
+    for (int i = 0; i < std::max (8, 8192/c.blockSize); ++i)
+        processBlock();
+
+    std::vector<double> results;
+
+    for (int r = 0; r < options.repeats; ++r)
+    {
+        double kernelNs = 0.0;
+        long long numBlocks = 0;
+
+        while (kernelNs < options.repeatSeconds*1.0e9)
+        {
+            kernelNs += processBlock();
+            ++numBlocks;
+        }
+
+        results.push_back (kernelNs/((double) numBlocks*c.blockSize*c.numChannels));
+    }
+
+    std::nth_element (results.begin(), results.begin() + results.size()/2, results.end());
+    return results[results.size()/2];
+}
+
+//==============================================================================
+static std::map<std::string, double> loadResults (const std::string& path)
+{
+    std::map<std::string, double> results;
+    std::ifstream file (path);
+    std::string line;
+
+    std::getline (file, line);  // header
+
+    // the key is every column but the last, which is ns/sample
+    while (std::getline (file, line))
+    {
+        const auto comma = line.rfind (',');
+
+        if (comma != std::string::npos)
+            results[line.substr (0, comma)] = std::atof (line.c_str() + comma + 1);
+    }
+
+    return results;
+}
+
+static void printUsage (const char* program)
+{
+    std::fprintf (stderr, "usage: %s [--blocks list] [--rates list] [--channels list] [--regimes flanger,vibrato,ringmod,chorus,feedback,ensemble,reverb,resonator]\n"
+                          "       [--interpolation linear|cubic|allpass|sinc] [--oversampling off|2x|4x|auto] [--precision float|double]\n"
+                          "       [--time seconds] [--repeats n] [--quick] [--save file.csv] [--baseline file.csv] [--tolerance fraction]\n", program);
+}
+
+static bool parseArguments (int argc, char* argv[], Options& options)
+{
+    for (auto& regime : regimes)
+        options.regimeList.push_back (&regime);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg == "--quick")
+        {
+            options.blockSizes = { 64, 512 };
+            options.sampleRates = { 48000 };
+            options.channelCounts = { 2 };
+            options.repeats = 3;
+            continue;
+        }
+
+        if (value == nullptr)
+            return false;
+
+        ++i;
+
+        if      (arg == "--blocks")         { if (! parseList (value, options.blockSizes))      return false; }
+        else if (arg == "--rates")          { if (! parseList (value, options.sampleRates))     return false; }
+        else if (arg == "--channels")       { if (! parseList (value, options.channelCounts))   return false; }
+        else if (arg == "--regimes")        { if (! parseRegimes (value, options.regimeList))   return false; }
+        else if (arg == "--interpolation")  options.interpolation = value;
+        else if (arg == "--oversampling")   options.oversampling = value;
+        else if (arg == "--precision")      options.precision = value;
+        else if (arg == "--time")           options.repeatSeconds = std::atof (value);
+        else if (arg == "--repeats")        options.repeats = std::atoi (value);
+        else if (arg == "--save")           options.savePath = value;
+        else if (arg == "--baseline")       options.baselinePath = value;
+        else if (arg == "--tolerance")      options.tolerance = std::atof (value);
+        else                                return false;
+    }
+
+    return findName (options.interpolation, interpolationNames) >= 0
+            && findName (options.oversampling, oversamplingNames) >= 0
+            && (options.precision == "float" || options.precision == "double")
+            && options.repeatSeconds > 0.0 && options.repeats > 0 && options.tolerance >= 0.0;
+}
+
+int main (int argc, char* argv[])
+{
+    Options options;
+
+    if (! parseArguments (argc, argv, options))
+    {
+        printUsage (argv[0]);
+        return 1;
+    }
+
+    std::vector<Case> cases;
+
+    for (auto* regime : options.regimeList)
+        for (auto sampleRate : options.sampleRates)
+            for (auto numChannels : options.channelCounts)
+                for (auto blockSize : options.blockSizes)
+                    cases.push_back ({ regime, blockSize, numChannels, sampleRate });
+
+    // the same white noise for every case
+    std::vector<float> floatSource (1 << 16);
+    std::mt19937 rng (1234);
+    std::uniform_real_distribution<float> dist (-0.5f, 0.5f);
+    for (auto& s : floatSource)
+        s = dist (rng);
+
+    const std::vector<double> doubleSource (floatSource.begin(), floatSource.end());
+
+    const bool isDouble = options.precision == "double";
+    const std::string settings = options.interpolation + "," + options.oversampling + "," + options.precision;
+    const auto baseline = options.baselinePath.empty() ? std::map<std::string, double>() : loadResults (options.baselinePath);
+
+    if (! options.baselinePath.empty() && baseline.empty())
+    {
+        std::fprintf (stderr, "couldn't read any results from %s\n", options.baselinePath.c_str());
+        return 1;
+    }
+
+    std::string csv = "regime,blockSize,sampleRate,channels,interpolation,oversampling,precision,nsPerSample\n";
+    int numRegressions = 0, numCompared = 0;
+
+    std::printf ("%-9s %6s %7s %3s %12s %10s %9s\n", "regime", "block", "rate", "ch", "ns/sample", "realtime", "baseline");
+
+    for (auto& c : cases)
+    {
+        const double ns = isDouble ? measure (c, options, doubleSource) : measure (c, options, floatSource);
+        const auto key = c.getKey (settings);
+        const double realtime = 1.0e9/(ns*c.sampleRate*c.numChannels);
+
+        char line[256];
+        std::snprintf (line, sizeof (line), "%s,%.4f\n", key.c_str(), ns);
+        csv += line;
+
+        std::printf ("%-9s %6d %7.0f %3d %12.3f %9.1fx", c.regime->name, c.blockSize, c.sampleRate, c.numChannels, ns, realtime);
+
+        const auto previous = baseline.find (key);
+
+        if (previous != baseline.end() && previous->second > 0.0)
+        {
+            const double change = ns/previous->second - 1.0;
+            const bool regressed = change > options.tolerance;
+            std::printf (" %+8.1f%%%s", change*100.0, regressed ? "  REGRESSION" : "");
+            numRegressions += regressed ? 1 : 0;
+            ++numCompared;
+        }
+
+        std::printf ("\n");
+        std::fflush (stdout);
+    }
+
+    if (! options.savePath.empty())
+    {
+        std::ofstream file (options.savePath);
+        file << csv;
+
+        if (! file)
+        {
+            std::fprintf (stderr, "couldn't write %s\n", options.savePath.c_str());
+            return 1;
+        }
+    }
+
+    if (! baseline.empty())
+    {
+        std::printf ("%d of %d cases compared with the baseline, %d slower by more than %.0f%%\n",
+                     numCompared, (int) cases.size(), numRegressions, options.tolerance*100.0);
+
+        if (numRegressions > 0)
+            return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,819 @@
+/*
+  ==============================================================================
+
+    Differential null test for CombEngine.
+
+    Runs the engine and ReferenceCombEngine side by side on randomised input,
+    parameter automation and block sizes, and fails if their outputs ever
+    differ by more than the tolerance for the interpolation in use (see
+    getToleranceFactor()), reporting the first sample that does.
+
+    usage: CombNullTest [--runs n] [--seconds s] [--seed n] [--tolerance t] [--precision float|double|both]
+           CombNullTest --checks
+
+    Each run picks a sample rate, channel count, maximum block size, maximum
+    delay, interpolation and oversampling factor, then alternates noise, tones,
+    clicks and silence (long enough for the engine to idle) while parameters
+    jump, ramp and change at timed offsets within blocks. In some runs the
+    maximum delay is raised as it goes, and the delay line is grown between
+    blocks, as a message thread would. The engine limits delays until the grown
+    line is in, which the reference doesn't, so those stretches are only
+    compared again once both have gone idle. The same seed always gives the same
+    runs. The exit code is 1 if any run fails.
+
+    --checks instead runs a few fixed scenarios that a comparison can't catch,
+    because the reference would share the fault, and checks the engine's state
+    directly.
+
+  ==============================================================================
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../../Source/CombEngine.h"
+#include "ReferenceCombEngine.h"
+
+//==============================================================================
+struct TestSettings
+{
+    int numRuns = 40;
+    double seconds = 2.0, tolerance = 5.0e-4;
+    unsigned seed = 1;
+    bool testFloat = true, testDouble = true;
+};
+
+struct RunConfig
+{
+    double sampleRate;
+    int numChannels, maxBlockSize;
+    float maxDelay;
+    InterpolationQuality interpolation;
+    OversamplingMode oversampling;
+    bool growth;
+};
+
+static const char* interpolationNames[] = { "linear", "cubic", "allpass", "sinc" };
+static const char* oversamplingNames[] = { "1x", "2x", "4x", "auto" };
+static const float maxDelays[] = { 0.05f, 0.1f, 0.25f, 0.55f };
+
+//==============================================================================
+/** Everything random about a run, from one seed. */
+class Randomiser
+{
+public:
+    explicit Randomiser (unsigned seed) : rng (seed) {}
+
+    double uniform (double low, double high)    { return std::uniform_real_distribution<double> (low, high) (rng); }
+    int integer (int low, int high)             { return std::uniform_int_distribution<int> (low, high) (rng); }
+    bool chance (double probability)            { return uniform (0.0, 1.0) < probability; }
+
+    template <typename Type, size_t N>
+    Type pick (const Type (&choices)[N])        { return choices[integer (0, (int) N - 1)]; }
+
+    RunConfig makeConfig()
+    {
+        const double sampleRates[] = { 44100.0, 48000.0, 88200.0, 96000.0 };
+        const int channelCounts[] = { 1, 2, 3, 4, 5, 8, 12, 16 };
+        const int blockSizes[] = { 16, 64, 256, 512, 1024, 4096 };
+        const OversamplingMode factors[] = { OversamplingMode::off, OversamplingMode::off, OversamplingMode::x2, OversamplingMode::x4 };
+
+        return { pick (sampleRates), pick (channelCounts), pick (blockSizes), pick (maxDelays),
+                 (InterpolationQuality) integer (0, (int) InterpolationQuality::numQualities - 1),
+                 pick (factors), chance (0.25) };
+    }
+
+    /** Parameters that cover every kernel path: short and long delays, static
+        and modulated taps, no feedback, feedback close to 1, slow and
+        audio-rate LFOs, a stopped LFO draining back to the centre, and one to
+        eight voices at random phases and depths. Now and then the oversampling
+        factor changes, and in growth runs so does the maximum delay.
+    */
+    CombParameters makeParameters (const RunConfig& config)
+    {
+        CombParameters p;
+        // the maximum delay is rarely raised, so that by the time it is there's
+        // history to carry over, and the delay goes straight out to read it. It
+        // comes back down the next time round
+        const bool raised = config.growth && chance (0.03);
+        p.maxDelay = raised ? maxDelays[3] : config.maxDelay;
+        p.interpolation = chance (0.05) ? (InterpolationQuality) integer (0, 3) : config.interpolation;
+        p.oversampling = chance (0.05) ? (OversamplingMode) integer (0, 2) : config.oversampling;
+
+        p.delay = raised ? (float) uniform (0.5*p.maxDelay, p.maxDelay)
+                         : chance (0.5) ? (float) uniform (0.0, 0.005) : (float) uniform (0.0, p.maxDelay);
+        p.sweepWidth = chance (0.3) ? 0.0f : (float) uniform (0.0, std::min (0.05, (double) p.maxDelay));
+
+        const int lfo = integer (0, 3);
+        p.lfoFreq = lfo == 0 ? 0.0f : (float) (lfo == 3 ? uniform (5.0, 250.0) : uniform (0.05, 5.0));
+
+        p.bleed = (float) uniform (0.0, 1.0);
+        p.feedforward = (float) uniform (0.0, 1.0);
+        p.feedback = chance (0.3) ? 0.0f : (float) uniform (0.0, 0.99);
+        p.tremolo = chance (0.2);
+
+        if (chance (0.5))
+        {
+            p.voices = integer (1, maxCombVoices);
+
+            for (int v = 0; v < maxCombVoices; ++v)
+            {
+                p.voicePhase[v] = chance (0.2) ? 0.0f : (float) uniform (0.0, 1.0);
+                p.voiceDepth[v] = chance (0.2) ? 1.0f : (float) uniform (0.0, 1.5);
+            }
+        }
+
+        return p;
+    }
+
+    /** A block size: usually up to the maximum, sometimes tiny or empty. */
+    int makeBlockSize (int maxBlockSize)
+    {
+        if (chance (0.02))
+            return 0;
+
+        if (chance (0.2))
+            return integer (1, std::min (16, maxBlockSize));
+
+        return chance (0.3) ? maxBlockSize : integer (1, maxBlockSize);
+    }
+
+    std::mt19937 rng;
+};
+
+//==============================================================================
+/** Test input: stretches of noise, tones, clicks and silence, the same on every channel
+    but for a per-channel gain and polarity.
+*/
+class SignalGenerator
+{
+public:
+    void next (Randomiser& random, double sampleRate)
+    {
+        if (--remaining > 0)
+            return;
+
+        kind = random.integer (0, 3);
+        remaining = (int) (random.uniform (0.02, kind == silence ? 1.5 : 0.5)*sampleRate);
+        amplitude = random.uniform (0.01, 1.0);
+        increment = random.uniform (20.0, 10000.0)/sampleRate;
+    }
+
+    double sample (Randomiser& random)
+    {
+        switch (kind)
+        {
+            case noise:     return amplitude*random.uniform (-1.0, 1.0);
+            case tone:      phase += increment; return amplitude*std::sin (6.283185307179586*(phase - std::floor (phase)));
+            case clicks:    return random.chance (0.001) ? amplitude : 0.0;
+            case silence:
+            default:        return 0.0;
+        }
+    }
+
+private:
+    enum { noise, tone, clicks, silence };
+
+    int kind = silence, remaining = 0;
+    double amplitude = 0.0, increment = 0.0, phase = 0.0;
+};
+
+//==============================================================================
+static const char* describe (const CombParameters& p, char* text, size_t size)
+{
+    std::snprintf (text, size, "delay %.4f s, width %.4f s, lfo %.2f Hz, bl %.3f, ff %.3f, fb %.3f, tremolo %s, %s, %d voice%s, %s, max delay %.2f s",
+                   p.delay, p.sweepWidth, p.lfoFreq, p.bleed, p.feedforward, p.feedback,
+                   p.tremolo ? "on" : "off", interpolationNames[(int) p.interpolation], p.voices, p.voices == 1 ? "" : "s",
+                   oversamplingNames[(int) p.oversampling], p.maxDelay);
+    return text;
+}
+
+/** How far the engine's output may stray from the reference's with each
+    interpolator, as a multiple of --tolerance, which is the bound for linear.
+
+    The engine's read positions are fixed point, with as few as 13 bits of
+    fraction at the longest delays, and its LFO is a recursive oscillator, so
+    its read head can be a few 1e-4 of a sample off the reference's exact one.
+    That moves a linearly interpolated tap by the position error times the
+    signal's slope, and feedback near 1 recirculates it many times over. Sinc
+    interpolation is continuous in the position too, but its eight taps weigh
+    in more of the signal's slope. Cubic rounds to the nearest of 1024
+    tabulated fractions, so the two can pick neighbouring rows. The allpass
+    filter changes taps when the position crosses a whole sample, so crossing
+    it a sample apart leaves a transient of a good fraction of the signal's
+    slope in its state. Over 1200 runs (seeds 1 to 30) the largest errors were
+    1.2e-4 (linear), 6.1e-4 (cubic), 1.8e-3 (sinc) and 4.2e-2 (allpass), and
+    the bounds leave room above those.
+*/
+static double getToleranceFactor (InterpolationQuality quality)
+{
+    switch (quality)
+    {
+        case InterpolationQuality::cubic:       return 4.0;
+        case InterpolationQuality::sinc:        return 10.0;
+        case InterpolationQuality::allpass:     return 200.0;
+        case InterpolationQuality::linear:
+        case InterpolationQuality::numQualities:
+        default:                                return 1.0;
+    }
+}
+
+/** Runs one randomised comparison, returning false at the first divergence. */
+template <typename SampleType>
+static bool runTest (int run, const TestSettings& settings, const char* precisionName)
+{
+    Randomiser random (settings.seed*7919u + (unsigned) run);
+    const auto config = random.makeConfig();
+
+    CombParameters params = random.makeParameters (config);
+
+    // an interpolator's errors linger in the delay line after it's switched
+    // away from, so its bound holds for the rest of the run
+    double tolerance = 0.0;
+    const auto useTolerance = [&] (const CombParameters& p) { tolerance = std::max (tolerance, settings.tolerance*getToleranceFactor (p.interpolation)); };
+    useTolerance (params);
+
+    CombEngine<SampleType> engine;
+    engine.setParameters (params);
+    engine.prepare (config.sampleRate, config.numChannels, config.maxBlockSize);
+
+    ReferenceCombEngine reference;
+    reference.setParameters (params);
+    reference.prepare (config.sampleRate, config.numChannels, config.growth ? maxDelays[3] : config.maxDelay);
+
+    std::vector<double> gains;
+    for (int channel = 0; channel < config.numChannels; ++channel)
+        gains.push_back (random.uniform (-1.0, 1.0));
+
+    std::vector<std::vector<SampleType>> engineBuffer ((size_t) config.numChannels, std::vector<SampleType> ((size_t) config.maxBlockSize));
+    std::vector<std::vector<double>> referenceBuffer ((size_t) config.numChannels, std::vector<double> ((size_t) config.maxBlockSize));
+    std::vector<SampleType*> engineChannels;
+    std::vector<double*> referenceChannels;
+
+    for (int channel = 0; channel < config.numChannels; ++channel)
+    {
+        engineChannels.push_back (engineBuffer[(size_t) channel].data());
+        referenceChannels.push_back (referenceBuffer[(size_t) channel].data());
+    }
+
+    SignalGenerator generator;
+    std::vector<CombParameterChange> changes;
+    const long long totalSamples = (long long) (settings.seconds*config.sampleRate);
+    long long position = 0, numBlocks = 0;
+    double maxError = 0.0, errorSquares = 0.0, referenceSquares = 0.0;
+    const int initialCapacity = engine.getDelayCapacity();
+    bool comparing = true;
+    char text[320];
+
+    while (position < totalSamples)
+    {
+        const int numSamples = random.makeBlockSize (config.maxBlockSize);
+
+        // sometimes fewer channels than were prepared, as some hosts do
+        const int numChannelsToProcess = random.chance (0.1) ? random.integer (1, config.numChannels) : config.numChannels;
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            generator.next (random, config.sampleRate);
+            const double x = generator.sample (random);
+
+            for (int channel = 0; channel < config.numChannels; ++channel)
+            {
+                // the reference gets the input exactly as the engine sees it
+                engineBuffer[(size_t) channel][(size_t) sample] = (SampleType) (gains[(size_t) channel]*x);
+                referenceBuffer[(size_t) channel][(size_t) sample] = (double) engineBuffer[(size_t) channel][(size_t) sample];
+            }
+        }
+
+        // the delay line grows here rather than on a message thread
+        if (engine.needsGrowing())
+            engine.growDelayLine();
+
+        const bool grown = engine.getDelayCapacity() > initialCapacity;
+        bool raised = params.maxDelay > config.maxDelay;
+
+        // parameters either jump at block boundaries and ramp over rampSeconds,
+        // or move to values at timed offsets within the block
+        changes.clear();
+
+        if (random.chance (0.25))
+        {
+            const int numChanges = random.integer (1, 3);
+
+            for (int i = 0; i < numChanges; ++i)
+            {
+                params = random.makeParameters (config);
+                changes.push_back ({ random.integer (0, numSamples), params });
+                raised = raised || params.maxDelay > config.maxDelay;
+                useTolerance (params);
+            }
+
+            std::sort (changes.begin(), changes.end(), [] (auto& a, auto& b) { return a.sampleOffset < b.sampleOffset; });
+
+            engine.process (engineChannels.data(), numChannelsToProcess, numSamples, changes.data(), (int) changes.size());
+            reference.process (referenceChannels.data(), numChannelsToProcess, numSamples, changes.data(), (int) changes.size());
+        }
+        else
+        {
+            if (random.chance (0.1))
+            {
+                params = random.makeParameters (config);
+                engine.setParameters (params);
+                reference.setParameters (params);
+                raised = raised || params.maxDelay > config.maxDelay;
+                useTolerance (params);
+            }
+
+            engine.process (engineChannels.data(), numChannelsToProcess, numSamples);
+            reference.process (referenceChannels.data(), numChannelsToProcess, numSamples);
+        }
+
+        // until the grown delay line is swapped in, the engine limits delays to
+        // the line it has, and the swap loses history the old line didn't hold.
+        // The reference has neither limit, so the comparison stops until both
+        // have gone idle (clearing their state) and the growth is over
+        if (raised && ! grown)
+            comparing = false;
+        else if (! comparing && engine.isIdle() && reference.isIdle() && ! engine.isGrowingDelayLine())
+            comparing = true;
+
+        for (int sample = 0; sample < numSamples && comparing; ++sample)
+        {
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            {
+                const double expected = referenceBuffer[(size_t) channel][(size_t) sample];
+                const double actual = (double) engineBuffer[(size_t) channel][(size_t) sample];
+                const double error = std::abs (actual - expected);
+
+                maxError = std::max (maxError, error);
+                errorSquares += error*error;
+                referenceSquares += expected*expected;
+
+                if (! (error <= tolerance))
+                {
+                    std::printf ("run %d (%s) FAILED: first divergence at sample %lld (block %lld, offset %d of %d), channel %d\n"
+                                 "  engine %.9g, reference %.9g, error %.3g, tolerance %.3g\n"
+                                 "  %.0f Hz, %d of %d channels, blocks up to %d, max delay %.2f s%s\n"
+                                 "  parameters: %s\n",
+                                 run, precisionName, position + sample, numBlocks, sample, numSamples, channel,
+                                 actual, expected, error, tolerance,
+                                 config.sampleRate, numChannelsToProcess, config.numChannels, config.maxBlockSize, config.maxDelay,
+                                 config.growth ? ", growing" : "", describe (params, text, sizeof (text)));
+                    return false;
+                }
+            }
+        }
+
+        position += numSamples;
+        ++numBlocks;
+    }
+
+    const double nullDepth = referenceSquares > 0.0 ? 10.0*std::log10 (std::max (errorSquares, 1.0e-300)/referenceSquares) : -std::numeric_limits<double>::infinity();
+
+    std::printf ("run %d (%s): %.0f Hz, %d ch, blocks up to %d, max delay %.2f s%s, %s, %s: max error %.3g of %.3g, null %.1f dB\n",
+                 run, precisionName, config.sampleRate, config.numChannels, config.maxBlockSize, config.maxDelay,
+                 config.growth ? " growing" : "", interpolationNames[(int) config.interpolation],
+                 oversamplingNames[(int) config.oversampling], maxError, tolerance, nullDepth);
+    return true;
+}
+
+//==============================================================================
+/** Hosts that pass every block's parameters as a change at its last sample
+    (as the plugin does) must still see the ramps settle, however short the
+    blocks are compared with minAutomationRampSeconds.
+*/
+template <typename SampleType>
+static bool checkRampsSettle (int blockSize, const char* precisionName)
+{
+    const double sampleRate = 48000.0;
+    CombParameters from, to;
+    from.delay = 0.002f;
+    from.feedback = 0.5f;
+    to.delay = 0.004f;
+    to.sweepWidth = 0.001f;
+    to.feedback = 0.8f;
+    to.bleed = 0.3f;
+    to.spreadVoices (4, 1.0f);
+
+    CombEngine<SampleType> engine;
+    engine.setParameters (from);
+    engine.prepare (sampleRate, 2, blockSize);
+
+    std::vector<SampleType> left ((size_t) blockSize), right ((size_t) blockSize);
+    SampleType* channels[] = { left.data(), right.data() };
+    const int numBlocks = (int) (0.1*sampleRate)/blockSize;
+    double phase = 0.0;
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        // a steady tone, so the engine never idles (which would snap the ramps)
+        for (int sample = 0; sample < blockSize; ++sample)
+        {
+            phase += 440.0/sampleRate;
+            left[(size_t) sample] = right[(size_t) sample] = (SampleType) (0.5*std::sin (6.283185307179586*phase));
+        }
+
+        const CombParameterChange change { blockSize, block == 0 ? from : to };
+        engine.process (channels, 2, blockSize, &change, 1);
+    }
+
+    const bool settled = ! engine.isSmoothing();
+    std::printf ("ramps settle with %d-sample blocks (%s): %s\n", blockSize, precisionName, settled ? "ok" : "FAILED, still ramping after 100 ms");
+    return settled;
+}
+
+//==============================================================================
+/** Where automatic oversampling changed factor: the first sample of the block
+    that switched, and the factors either side.
+*/
+struct FactorSwitch
+{
+    int start, from, to;
+};
+
+static CombParameters makeSweepParameters (OversamplingMode mode, float feedback)
+{
+    CombParameters params;
+    params.delay = 0.003f;
+    params.sweepWidth = 0.002f;
+    params.feedback = feedback;
+    params.oversampling = mode;
+    params.spreadVoices (4, 0.5f);
+    return params;
+}
+
+/** Runs a tone through the engine while the LFO speeds up and slows down again,
+    so automatic oversampling goes 1x, 2x, 4x, 2x, 1x, 4x, 1x, returning the left
+    channel, and where the factor changed, if asked for. If otherDelay is above
+    0, the delay also swaps between params.delay and otherDelay as each step of
+    the LFO starts, so every switch comes in the middle of a delay ramp.
+*/
+template <typename SampleType>
+static std::vector<double> renderLfoSweep (CombParameters params, int blockSize, float otherDelay, std::vector<FactorSwitch>* switches)
+{
+    const double sampleRate = 48000.0;
+    const float lfoFrequencies[] = { 10.0f, 50.0f, 200.0f, 50.0f, 10.0f, 200.0f, 10.0f };
+    const int numSegments = (int) (sizeof (lfoFrequencies)/sizeof (lfoFrequencies[0]));
+    const int numBlocks = (int) sampleRate/blockSize;
+    const float delays[] = { params.delay, otherDelay > 0.0f ? otherDelay : params.delay };
+
+    CombEngine<SampleType> engine;
+    engine.prepare (sampleRate, 2, blockSize);
+
+    std::vector<SampleType> left ((size_t) blockSize), right ((size_t) blockSize);
+    SampleType* channels[] = { left.data(), right.data() };
+    std::vector<double> output;
+    int factor = 0;
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        const int segment = block*numSegments/numBlocks;
+        params.lfoFreq = lfoFrequencies[segment];
+        params.delay = delays[segment % 2];
+        engine.setParameters (params);
+
+        for (int sample = 0; sample < blockSize; ++sample)
+        {
+            const double t = (double) (block*blockSize + sample)/sampleRate;
+            left[(size_t) sample] = (SampleType) (0.3*std::sin (6.283185307179586*220.0*t) + 0.2*std::sin (6.283185307179586*1250.0*t));
+            right[(size_t) sample] = (SampleType) (0.5*std::sin (6.283185307179586*97.0*t));
+        }
+
+        engine.process (channels, 2, blockSize);
+
+        if (switches != nullptr && block > 0 && engine.getOversamplingFactor() != factor)
+            switches->push_back ({ block*blockSize, factor, engine.getOversamplingFactor() });
+
+        factor = engine.getOversamplingFactor();
+        output.insert (output.end(), left.begin(), left.end());
+    }
+
+    return output;
+}
+
+static double getLargestStep (const std::vector<double>& signal, int start, int end)
+{
+    double largest = 0.0;
+
+    for (int i = std::max (1, start); i < std::min (end, (int) signal.size()); ++i)
+        largest = std::max (largest, std::abs (signal[(size_t) i] - signal[(size_t) (i - 1)]));
+
+    return largest;
+}
+
+/** Automatic oversampling changes factor mid-play, so each switch must be no
+    rougher than the same passage at a fixed factor: the largest step between
+    samples around it may be at most half as large again as at 1x or 4x. A
+    switch that dropped the delay line, or didn't line the resampled history up
+    with what follows, would step far further.
+*/
+template <typename SampleType>
+static bool checkAutomaticSwitching (int blockSize, const char* precisionName)
+{
+    std::vector<FactorSwitch> switches;
+    const auto automatic = renderLfoSweep<SampleType> (makeSweepParameters (OversamplingMode::automatic, 0.6f), blockSize, 0.0f, &switches);
+    const auto fixed1x = renderLfoSweep<SampleType> (makeSweepParameters (OversamplingMode::off, 0.6f), blockSize, 0.0f, nullptr);
+    const auto fixed4x = renderLfoSweep<SampleType> (makeSweepParameters (OversamplingMode::x4, 0.6f), blockSize, 0.0f, nullptr);
+    double worst = 0.0;
+
+    for (auto& s : switches)
+    {
+        const int start = s.start, end = start + 300;
+        const double reference = std::max (getLargestStep (fixed1x, start - 8, end), getLargestStep (fixed4x, start - 8, end));
+        worst = std::max (worst, getLargestStep (automatic, start - 8, end)/reference);
+    }
+
+    const bool smooth = switches.size() >= 4 && worst <= 1.5;
+
+    if (switches.size() < 4)
+        std::printf ("automatic oversampling switches smoothly with %d-sample blocks (%s): FAILED, only %d switches\n",
+                     blockSize, precisionName, (int) switches.size());
+    else
+        std::printf ("automatic oversampling switches smoothly with %d-sample blocks (%s): %s, largest step %.2fx a fixed factor's\n",
+                     blockSize, precisionName, smooth ? "ok" : "FAILED", worst);
+
+    return smooth;
+}
+
+/** After each switch, automatic oversampling must carry on as the new factor
+    would have had it been running all along. Without feedback, the output only
+    depends on the last few milliseconds of history, so once the crossfade is
+    over it must match a render at that fixed factor (held back by the
+    difference in latency) to within -70 dB of the signal. The first frames
+    after a switch read the history resampleHistory() made from the old
+    factor's, and everything else depends on saveState() and restoreState()
+    having put back all that the old factor's render changed, and on ramps
+    under way carrying on at the new rate. Every direction is checked, with
+    and without a delay ramp running through the switch.
+*/
+template <typename SampleType>
+static bool checkSwitchesMatchFixedFactor (bool duringRamp, const char* precisionName)
+{
+    const int blockSize = 256;
+    const float otherDelay = duringRamp ? 0.014f : 0.0f;
+    const auto fixedMode = [] (int factor) { return factor == 4 ? OversamplingMode::x4 : factor == 2 ? OversamplingMode::x2 : OversamplingMode::off; };
+
+    // a delay long enough that the history from before the switch is still
+    // being read once the crossfade is over
+    const auto makeParameters = [] (OversamplingMode mode)
+    {
+        auto params = makeSweepParameters (mode, 0.0f);
+        params.delay = 0.01f;
+        return params;
+    };
+
+    std::vector<FactorSwitch> switches;
+    const auto automatic = renderLfoSweep<SampleType> (makeParameters (OversamplingMode::automatic), blockSize, otherDelay, &switches);
+    std::vector<double> fixed[5];
+
+    for (int factor : { 1, 2, 4 })
+        fixed[factor] = renderLfoSweep<SampleType> (makeParameters (fixedMode (factor)), blockSize, otherDelay, nullptr);
+
+    CombEngine<SampleType> engine;
+    engine.prepare (48000.0, 2, blockSize);
+
+    const int settleSamples = (int) (CombEngine<SampleType>::switchCrossfadeSeconds*48000.0) + 64;
+    bool ok = switches.size() == 6;
+    std::string report;
+
+    for (size_t i = 0; i < switches.size(); ++i)
+    {
+        const auto& s = switches[i];
+        const auto& expected = fixed[s.to];
+        const int shift = engine.getLatencySamples (OversamplingMode::automatic) - engine.getLatencySamples (fixedMode (s.to));
+        const int end = i + 1 < switches.size() ? switches[i + 1].start : (int) automatic.size();
+        double error = 0.0, peak = 0.0;
+
+        for (int n = s.start + settleSamples; n < end; ++n)
+        {
+            error = std::max (error, std::abs (automatic[(size_t) n] - expected[(size_t) (n - shift)]));
+            peak = std::max (peak, std::abs (expected[(size_t) (n - shift)]));
+        }
+
+        const double errorDb = 20.0*std::log10 (std::max (error, 1.0e-12)/std::max (peak, 1.0e-12));
+        ok = ok && errorDb < -70.0;
+
+        char text[64];
+        std::snprintf (text, sizeof (text), "%s%dx to %dx %.0f dB", i > 0 ? ", " : "", s.from, s.to, errorDb);
+        report += text;
+    }
+
+    std::printf ("automatic oversampling matches a fixed factor after each switch%s (%s): %s, %s\n",
+                 duringRamp ? " during a delay ramp" : "", precisionName, ok ? "ok" : "FAILED",
+                 switches.size() == 6 ? report.c_str() : "expected 6 switches");
+    return ok;
+}
+
+//==============================================================================
+/** Restoring a state with a longer maximum delay reserves the delay line up
+    front, because offline renders may have no message loop to call
+    growDelayLine(). process() must then carry the history over to it and swap
+    it in by itself, so an echo longer than the old maximum comes back.
+*/
+template <typename SampleType>
+static bool checkGrowthWithoutTimer (const char* precisionName)
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 64;
+    CombParameters params;
+    params.delay = 0.01f;
+    params.sweepWidth = 0.0f;
+    params.feedforward = 1.0f;
+    params.feedback = 0.0f;
+    params.bleed = 0.0f;
+    params.maxDelay = 0.05f;
+
+    CombEngine<SampleType> engine;
+    engine.setParameters (params);
+    engine.prepare (sampleRate, 2, blockSize);
+    engine.reserveDelay (0.5);
+
+    params.delay = 0.3f;
+    params.maxDelay = 0.5f;
+    engine.setParameters (params);
+
+    std::vector<SampleType> left ((size_t) blockSize), right ((size_t) blockSize);
+    SampleType* channels[] = { left.data(), right.data() };
+    const int impulseAt = (int) (0.1*sampleRate), echoAt = impulseAt + (int) (0.3*sampleRate);
+    double echo = 0.0;
+
+    for (int start = 0; start < echoAt + blockSize; start += blockSize)
+    {
+        for (int sample = 0; sample < blockSize; ++sample)
+            left[(size_t) sample] = right[(size_t) sample] = start + sample == impulseAt ? SampleType (1) : SampleType();
+
+        engine.process (channels, 2, blockSize);
+
+        for (int sample = 0; sample < blockSize; ++sample)
+            if (std::abs (start + sample - echoAt) <= 8)
+                echo = std::max (echo, std::abs ((double) left[(size_t) sample]));
+    }
+
+    const bool grown = ! engine.isGrowingDelayLine() && engine.getDelayCapacity() >= (int) (0.5*sampleRate);
+    const bool ok = grown && echo > 0.5;
+
+    std::printf ("delay line grows without a message thread (%s): %s\n", precisionName,
+                 ok ? "ok" : grown ? "FAILED, no echo at the new delay" : "FAILED, the delay line wasn't grown");
+    return ok;
+}
+
+//==============================================================================
+/** With no delay and no sweep the comb still rings, at minDelaySamples, so the
+    reported tail (plus the latency) must cover an impulse's echoes until they
+    fall below silenceThreshold, at high feedback and with oversampling too.
+*/
+template <typename SampleType>
+static bool checkTailLength (OversamplingMode mode, const char* precisionName)
+{
+    const double sampleRate = 48000.0;
+    const int blockSize = 64;
+    CombParameters params;
+    params.delay = 0.0f;
+    params.sweepWidth = 0.0f;
+    params.feedforward = 1.0f;
+    params.feedback = 0.99f;
+    params.bleed = 0.0f;
+    params.oversampling = mode;
+
+    CombEngine<SampleType> engine;
+    engine.setParameters (params);
+    engine.prepare (sampleRate, 1, blockSize);
+
+    const int tailSamples = (int) std::ceil (CombEngine<SampleType>::getTailLengthSeconds (params, sampleRate)*sampleRate)
+                          + engine.getLatencySamples();
+    std::vector<SampleType> buffer ((size_t) blockSize);
+    SampleType* channels[] = { buffer.data() };
+    int lastAudible = 0;
+
+    for (int start = 0; start < 4*tailSamples + blockSize; start += blockSize)
+    {
+        std::fill (buffer.begin(), buffer.end(), SampleType());
+
+        if (start == 0)
+            buffer[0] = SampleType (1);
+
+        engine.process (channels, 1, blockSize);
+
+        for (int sample = 0; sample < blockSize; ++sample)
+            if (std::abs ((double) buffer[(size_t) sample]) > CombEngine<SampleType>::silenceThreshold)
+                lastAudible = start + sample;
+    }
+
+    const bool covered = lastAudible < tailSamples;
+    std::printf ("tail covers a zero delay at %s (%s): %s, rings for %d samples, reports %d\n",
+                 oversamplingNames[(int) mode], precisionName, covered ? "ok" : "FAILED", lastAudible + 1, tailSamples);
+    return covered;
+}
+
+static int runChecks (const TestSettings& settings)
+{
+    int numFailed = 0;
+
+    for (int blockSize : { 32, 64 })
+    {
+        if (settings.testFloat && ! checkRampsSettle<float> (blockSize, "float"))
+            ++numFailed;
+
+        if (settings.testDouble && ! checkRampsSettle<double> (blockSize, "double"))
+            ++numFailed;
+    }
+
+    for (int blockSize : { 16, 256 })
+    {
+        if (settings.testFloat && ! checkAutomaticSwitching<float> (blockSize, "float"))
+            ++numFailed;
+
+        if (settings.testDouble && ! checkAutomaticSwitching<double> (blockSize, "double"))
+            ++numFailed;
+    }
+
+    for (bool duringRamp : { false, true })
+    {
+        if (settings.testFloat && ! checkSwitchesMatchFixedFactor<float> (duringRamp, "float"))
+            ++numFailed;
+
+        if (settings.testDouble && ! checkSwitchesMatchFixedFactor<double> (duringRamp, "double"))
+            ++numFailed;
+    }
+
+    if (settings.testFloat && ! checkGrowthWithoutTimer<float> ("float"))
+        ++numFailed;
+
+    if (settings.testDouble && ! checkGrowthWithoutTimer<double> ("double"))
+        ++numFailed;
+
+    for (auto mode : { OversamplingMode::off, OversamplingMode::x4 })
+    {
+        if (settings.testFloat && ! checkTailLength<float> (mode, "float"))
+            ++numFailed;
+
+        if (settings.testDouble && ! checkTailLength<double> (mode, "double"))
+            ++numFailed;
+    }
+
+    return numFailed > 0 ? 1 : 0;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    TestSettings settings;
+    bool valid = true;
+
+    if (argc == 2 && std::strcmp (argv[1], "--checks") == 0)
+        return runChecks (settings);
+
+    for (int i = 1; i + 1 < argc && valid; i += 2)
+    {
+        const std::string arg = argv[i];
+        const char* value = argv[i + 1];
+
+        if      (arg == "--runs")       settings.numRuns = std::atoi (value);
+        else if (arg == "--seconds")    settings.seconds = std::atof (value);
+        else if (arg == "--seed")       settings.seed = (unsigned) std::strtoul (value, nullptr, 10);
+        else if (arg == "--tolerance")  settings.tolerance = std::atof (value);
+        else if (arg == "--precision")
+        {
+            settings.testFloat = std::strcmp (value, "double") != 0;
+            settings.testDouble = std::strcmp (value, "float") != 0;
+            valid = std::strcmp (value, "float") == 0 || std::strcmp (value, "double") == 0 || std::strcmp (value, "both") == 0;
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    if (! valid || argc % 2 == 0 || settings.numRuns <= 0 || settings.seconds <= 0.0 || settings.tolerance < 0.0)
+    {
+        std::fprintf (stderr, "usage: %s [--runs n] [--seconds s] [--seed n] [--tolerance t] [--precision float|double|both]\n"
+                              "       %s --checks\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int numFailed = 0;
+
+    for (int run = 0; run < settings.numRuns; ++run)
+    {
+        if (settings.testFloat && ! runTest<float> (run, settings, "float"))
+            ++numFailed;
+
+        if (settings.testDouble && ! runTest<double> (run, settings, "double"))
+            ++numFailed;
+    }
+
+    const int numTests = settings.numRuns*((settings.testFloat ? 1 : 0) + (settings.testDouble ? 1 : 0));
+    std::printf ("%d of %d runs nulled within %g (linear), %g (cubic), %g (sinc) and %g (allpass) (seed %u)\n",
+                 numTests - numFailed, numTests, settings.tolerance,
+                 settings.tolerance*getToleranceFactor (InterpolationQuality::cubic),
+                 settings.tolerance*getToleranceFactor (InterpolationQuality::sinc),
+                 settings.tolerance*getToleranceFactor (InterpolationQuality::allpass), settings.seed);
+    return numFailed > 0 ? 1 : 0;
+}
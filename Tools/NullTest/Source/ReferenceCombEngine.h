@@ -0,0 +1,741 @@
+/*
+  ==============================================================================
+
+    ReferenceCombEngine.h
+
+    Frozen scalar reference for CombEngine, used by the null test.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+#include "../../../Source/CombEngine.h"
+
+//==============================================================================
+/**
+    The comb filter written out the obvious way: one channel and one sample at a
+    time, with its own delay lines, ramps, LFO and interpolation coefficients,
+    and no block paths, vectors or lookup shortcuts of any kind.
+
+    It defines what CombEngine is meant to compute with oversampling off or at
+    a fixed factor (automatic switching isn't modelled), and must only change
+    when the sound is meant to change. Only CombParameters and
+    the enums are shared with the engine. Optimisations go in CombEngine and are
+    checked against this by Tools/NullTest.
+
+    The rules the engine's output depends on are reproduced exactly:
+     - continuous parameters are float, and ramp linearly over rampSeconds from
+       the start of each process() call, or between timed changes over at least
+       minAutomationRampSeconds, snapping on the first block. A change to the
+       target a ramp is already heading for leaves it as it is;
+     - the LFO is 0.5 + 0.5*sin(2*pi*phase), and drains to phase 0 at
+       drainFrequency when its frequency is 0;
+     - voice v reads its own tap at delay + depth_v*width*lfo_v, where lfo_v is
+       lfo*cos + 0.5*cos(2*pi*phase)*sin + 0.5*(1 - cos) for the cos and sin of
+       its phase offset, and the taps are summed with gains of 1/voices. A
+       voice's cos, sin, depth and gain ramp together, restarting whenever any
+       of them changes, and a silent voice takes its new shape at once;
+     - the read head trails the write head by minDelaySamples plus the delay,
+       and for allpass half a sample more, with the filter's own delay half a
+       sample plus the fraction;
+     - the delay and its modulation are added in double and clamped, and the
+       read position is split into a whole delay and a fraction from there;
+     - the interpolators use tables of 1024 phases, rounded to the nearest
+       phase for cubic and linearly interpolated for sinc;
+     - each block or segment is zeroed and the state cleared once everything
+       the delay line still holds is silent and the input is too;
+     - oversampling runs the kernel at 2x or 4x (at most 192 kHz) between
+       half-band filters of 7 allpass sections, and 3 more for the second
+       octave. Changing factor starts again from silence, but keeps the LFO's
+       phase.
+
+    The engine is allowed to compute the LFO and read positions more cheaply
+    (a recursive oscillator, fixed-point positions) and to limit delays while
+    its delay line grows. Those differences are bounded by the null test, not
+    copied here.
+*/
+class ReferenceCombEngine
+{
+public:
+    static constexpr int minDelaySamples = 3;
+    static constexpr double rampSeconds = 0.02, minAutomationRampSeconds = 0.005;
+    static constexpr double silenceThreshold = 1.0e-5;
+    static constexpr double drainFrequency = 0.05, parkedPhase = 0.01;
+    static constexpr int numPhases = 1024, maxTaps = 8;
+    static constexpr double maxKernelRate = 192000.0;
+
+    //==============================================================================
+    /** maxDelaySeconds is the longest maxDelay the parameters will ask for. */
+    void prepare (double newSampleRate, int newNumChannels, float maxDelaySeconds)
+    {
+        hostSampleRate = sampleRate = newSampleRate;
+        numChannels = std::max (1, newNumChannels);
+
+        for (maxFactor = 4; maxFactor > 1 && hostSampleRate*maxFactor > maxKernelRate;)
+            maxFactor /= 2;
+
+        historyLength = (int) (std::max (0.0, (double) maxDelaySeconds)*hostSampleRate*maxFactor) + minDelaySamples + maxTaps + 2;
+        history.assign ((size_t) numChannels, std::vector<double> ((size_t) historyLength, 0.0));
+        allpassState.assign ((size_t) (numChannels*maxCombVoices), 0.0);
+        kernelFrames.assign ((size_t) (4*numChannels), 0.0);
+
+        for (auto* stages : { upStages, downStages })
+        {
+            stages[0].design (7, 0.045);
+            stages[1].design (3, 0.25);
+            stages[0].prepare (numChannels);
+            stages[1].prepare (numChannels);
+        }
+
+        buildTables();
+        factor = 0;
+        phase = 0.0;
+        clearSignalState();
+    }
+
+    void setParameters (const CombParameters& newParams) noexcept   { params = newParams; }
+
+    /** True once everything has decayed and the state has been cleared. */
+    bool isIdle() const noexcept                                    { return idle; }
+
+    //==============================================================================
+    template <typename SampleType>
+    void process (SampleType* const* channels, int numChannelsToProcess, int numSamples)
+    {
+        processSegment (channels, numChannelsToProcess, 0, numSamples, -1);
+    }
+
+    template <typename SampleType>
+    void process (SampleType* const* channels, int numChannelsToProcess, int numSamples,
+                  const CombParameterChange* changes, int numChanges)
+    {
+        const int minRampSamples = (int) (minAutomationRampSeconds*hostSampleRate);
+        int position = 0;
+
+        for (int i = 0; i < numChanges; ++i)
+        {
+            const int end = std::min (std::max (changes[i].sampleOffset, position), numSamples);
+
+            params = changes[i].params;
+            processSegment (channels, numChannelsToProcess, position, end - position, std::max (end - position, minRampSamples));
+            position = end;
+        }
+
+        if (position < numSamples)
+            processSegment (channels, numChannelsToProcess, position, numSamples - position, -1);
+    }
+
+private:
+    /** A linear ramp in float, stepping exactly as the engine's does. The last
+        step gives the accumulated value, and only after it does the ramp sit
+        exactly on its target.
+    */
+    struct Ramp
+    {
+        float current = 0.0f, target = 0.0f, step = 0.0f;
+        int countdown = 0;
+
+        void snap (float value) noexcept    { current = target = value; countdown = 0; }
+
+        /** Starts a ramp of numSteps if the target has changed. */
+        void rampTo (float newTarget, int numSteps) noexcept
+        {
+            if (newTarget != target)
+            {
+                target = newTarget;
+                countdown = numSteps;
+                step = (target - current)/(float) countdown;
+            }
+        }
+
+        /** Reaches newTarget in exactly numSteps, unless it was already the target. */
+        void reachIn (float newTarget, int numSteps) noexcept
+        {
+            if (newTarget == target)
+                return;
+
+            target = newTarget;
+            countdown = current == target ? 0 : std::max (1, numSteps);
+            step = countdown > 0 ? (target - current)/(float) countdown : 0.0f;
+        }
+
+        float next() noexcept
+        {
+            if (countdown == 0)
+                return current;
+
+            current += step;
+            const float value = current;
+
+            if (--countdown == 0)
+                current = target;
+
+            return value;
+        }
+    };
+
+    enum { delayRamp, widthRamp, bleedRamp, feedforwardRamp, feedbackRamp, tremoloRamp, numRamps };
+
+    /** One voice's coefficients, ramping together in a straight line from start
+        and reaching start + step*k after k samples.
+    */
+    struct VoiceRamp
+    {
+        enum { cosine, sine, depth, gain, numCoefficients };
+
+        float start[numCoefficients] = {}, step[numCoefficients] = {}, target[numCoefficients] = {};
+        int length = 0, position = 0;
+
+        float valueAt (int k, int c) const noexcept     { return k < length ? start[c] + step[c]*(float) k : target[c]; }
+        float current (int c) const noexcept            { return valueAt (position, c); }
+        bool isSilent() const noexcept                  { return current (gain) == 0.0f && target[gain] == 0.0f; }
+
+        void setTargets (const float (&newTargets)[numCoefficients], bool snap, bool timed, int numSteps) noexcept
+        {
+            float values[numCoefficients];
+            bool changed = false, moving = false;
+
+            for (int c = 0; c < numCoefficients; ++c)
+            {
+                values[c] = current (c);
+                changed = changed || newTargets[c] != target[c];
+                moving = moving || newTargets[c] != values[c];
+            }
+
+            if (values[gain] == 0.0f && position >= length)
+                for (int c = 0; c < gain; ++c)
+                    values[c] = newTargets[c];
+
+            if (snap || (timed && ! moving))
+            {
+                length = position = 0;
+            }
+            else if (changed)
+            {
+                length = std::max (1, numSteps);
+                position = 0;
+
+                for (int c = 0; c < numCoefficients; ++c)
+                {
+                    start[c] = values[c];
+                    step[c] = (newTargets[c] - values[c])/(float) length;
+                }
+            }
+
+            for (int c = 0; c < numCoefficients; ++c)
+                target[c] = newTargets[c];
+        }
+
+        /** Takes a step and returns the coefficients after it. */
+        void next (float (&values)[numCoefficients]) noexcept
+        {
+            position = std::min (length, position + 1);
+
+            for (int c = 0; c < numCoefficients; ++c)
+                values[c] = current (c);
+        }
+    };
+
+    /** One 2x half-band stage, for every channel: two chains of allpass sections
+        y[n] = c*(x[n] - y[n-2]) + x[n-2] at the higher rate, with the
+        coefficients alternating between them, designed as elliptic half-bands
+        (Valenzuela & Constantinides).
+    */
+    struct HalfBandStage
+    {
+        std::vector<double> coefficients, inputs, outputs;
+
+        void design (int numCoefficients, double transitionBandwidth)
+        {
+            const int order = numCoefficients*2 + 1;
+            double k = std::tan ((1.0 - transitionBandwidth*2.0)*pi/4.0);
+            k *= k;
+            const double kRoot = std::pow (1.0 - k*k, 0.25);
+            const double e = 0.5*(1.0 - kRoot)/(1.0 + kRoot);
+            const double e4 = e*e*e*e;
+            const double q = e*(1.0 + e4*(2.0 + e4*(15.0 + 150.0*e4)));
+
+            coefficients.clear();
+
+            for (int c = 1; c <= numCoefficients; ++c)
+            {
+                double num = 0.0, den = 0.0, term = 0.0;
+
+                for (int i = 0; i == 0 || std::abs (term) > 1.0e-100; ++i)
+                    num += (term = std::pow (q, i*(i + 1))*std::sin ((i*2 + 1)*c*pi/order)*(i % 2 == 0 ? 1.0 : -1.0));
+
+                for (int i = 1; i == 1 || std::abs (term) > 1.0e-100; ++i)
+                    den += (term = std::pow (q, i*i)*std::cos (i*2*c*pi/order)*(i % 2 == 0 ? 1.0 : -1.0));
+
+                const double ww = num*std::pow (q, 0.25)/(den + 0.5);
+                const double x = std::sqrt ((1.0 - ww*ww*k)*(1.0 - ww*ww/k))/(1.0 + ww*ww);
+                coefficients.push_back ((1.0 - x)/(1.0 + x));
+            }
+        }
+
+        void prepare (int numChannels)
+        {
+            inputs.assign (coefficients.size()*(size_t) numChannels, 0.0);
+            outputs.assign (coefficients.size()*(size_t) numChannels, 0.0);
+        }
+
+        void reset() noexcept
+        {
+            std::fill (inputs.begin(), inputs.end(), 0.0);
+            std::fill (outputs.begin(), outputs.end(), 0.0);
+        }
+
+        /** Runs the even and odd samples through their chains. */
+        void filter (int channel, double& even, double& odd) noexcept
+        {
+            for (size_t i = 0; i < coefficients.size(); ++i)
+            {
+                double& x = i % 2 == 0 ? even : odd;
+                const size_t index = (size_t) channel*coefficients.size() + i;
+                const double y = coefficients[i]*(x - outputs[index]) + inputs[index];
+
+                inputs[index] = x;
+                outputs[index] = y;
+                x = y;
+            }
+        }
+
+        /** Turns one sample at the lower rate into two at the higher. */
+        void up (int channel, double x, double& first, double& second) noexcept
+        {
+            first = second = x;
+            filter (channel, first, second);
+        }
+
+        /** Turns two samples at the higher rate into one at the lower. */
+        double down (int channel, double first, double second) noexcept
+        {
+            filter (channel, second, first);
+            return 0.5*(first + second);
+        }
+    };
+
+    void clearSignalState() noexcept
+    {
+        for (auto& channel : history)
+            std::fill (channel.begin(), channel.end(), 0.0);
+
+        std::fill (allpassState.begin(), allpassState.end(), 0.0);
+
+        for (int i = 0; i < 2; ++i)
+        {
+            upStages[i].reset();
+            downStages[i].reset();
+        }
+
+        writeIndex = 0;
+        snapRamps = true;
+        numSilentSamples = std::numeric_limits<int>::max()/2;
+    }
+
+    template <typename SampleType>
+    void processSegment (SampleType* const* channels, int numChannelsToProcess, int offset, int numSamples, int rampSamples)
+    {
+        const int newFactor = params.oversampling == OversamplingMode::x4 ? std::min (4, maxFactor)
+                            : params.oversampling == OversamplingMode::x2 ? std::min (2, maxFactor) : 1;
+
+        // the history is at the old rate, so it starts again from silence
+        if (newFactor != factor)
+        {
+            factor = newFactor;
+            sampleRate = hostSampleRate*factor;
+            clearSignalState();
+        }
+
+        updateMaxDelaySamples();
+        numChannelsToProcess = std::min (numChannelsToProcess, numChannels);
+
+        // while idle the ramps jump straight to their targets
+        snapRamps = snapRamps || idle;
+
+        // the minimum gap is in kernel samples, so oversampling makes up the difference
+        const float targets[numRamps] = { params.delay*(float) sampleRate + (float) (minDelaySamples*(factor - 1)), params.sweepWidth*(float) sampleRate,
+                                          params.bleed, params.feedforward, params.feedback, params.tremolo ? 1.0f : 0.0f };
+        const int defaultRamp = std::max (1, (int) (rampSeconds*sampleRate));
+        const int rampFrames = rampSamples < 0 ? -1 : rampSamples*factor;
+
+        for (int i = 0; i < numRamps; ++i)
+        {
+            if (snapRamps)
+                ramps[i].snap (targets[i]);
+            else if (rampFrames >= 0)
+                ramps[i].reachIn (targets[i], rampFrames);
+            else
+                ramps[i].rampTo (targets[i], defaultRamp);
+        }
+
+        const int numVoices = std::min (std::max (params.voices, 1), maxCombVoices);
+
+        for (int v = 0; v < maxCombVoices; ++v)
+        {
+            auto& voice = voices[v];
+            float voiceTargets[VoiceRamp::numCoefficients] = { voice.target[VoiceRamp::cosine], voice.target[VoiceRamp::sine],
+                                                               voice.target[VoiceRamp::depth], 0.0f };
+
+            if (v < numVoices)
+            {
+                voiceTargets[VoiceRamp::cosine] = (float) std::cos (twoPi*(double) params.voicePhase[v]);
+                voiceTargets[VoiceRamp::sine] = (float) std::sin (twoPi*(double) params.voicePhase[v]);
+                voiceTargets[VoiceRamp::depth] = params.voiceDepth[v];
+                voiceTargets[VoiceRamp::gain] = 1.0f/(float) numVoices;
+            }
+
+            voice.setTargets (voiceTargets, snapRamps, rampFrames >= 0, rampFrames >= 0 ? rampFrames : defaultRamp);
+        }
+
+        snapRamps = false;
+
+        if (numSamples <= 0)
+            return;
+
+        if (params.interpolation != interpolation)
+        {
+            std::fill (allpassState.begin(), allpassState.end(), 0.0);
+            interpolation = params.interpolation;
+        }
+
+        // idle: everything readable has decayed and the input is silent too
+        bool inputSilent = true;
+
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            for (int sample = 0; sample < numSamples; ++sample)
+                inputSilent = inputSilent && std::abs ((double) channels[channel][offset + sample]) < silenceThreshold;
+
+        if (numSilentSamples > (int) maxDelaySamples + minDelaySamples + maxTaps && inputSilent)
+        {
+            if (! idle)
+            {
+                clearSignalState();
+                idle = true;
+            }
+
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+                std::fill (channels[channel] + offset, channels[channel] + offset + numSamples, SampleType());
+
+            float quadrature;
+
+            for (int frame = 0; frame < numSamples*factor; ++frame)
+                nextLfo (quadrature);
+
+            return;
+        }
+
+        idle = false;
+        wroteSound = false;
+
+        double* frames = kernelFrames.data();
+        double stageFrames[2];
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            // frames[k*numChannels + channel] is channel's kth kernel sample
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                const double x = channel < numChannelsToProcess ? (double) channels[channel][offset + sample] : 0.0;
+
+                if (factor == 1)
+                {
+                    frames[channel] = x;
+                }
+                else if (factor == 2)
+                {
+                    upStages[0].up (channel, x, frames[channel], frames[numChannels + channel]);
+                }
+                else
+                {
+                    upStages[0].up (channel, x, stageFrames[0], stageFrames[1]);
+                    upStages[1].up (channel, stageFrames[0], frames[channel], frames[numChannels + channel]);
+                    upStages[1].up (channel, stageFrames[1], frames[numChannels*2 + channel], frames[numChannels*3 + channel]);
+                }
+            }
+
+            for (int k = 0; k < factor; ++k)
+                processFrame (frames + k*numChannels);
+
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            {
+                double y = frames[channel];
+
+                if (factor == 2)
+                {
+                    y = downStages[0].down (channel, frames[channel], frames[numChannels + channel]);
+                }
+                else if (factor == 4)
+                {
+                    const double first = downStages[1].down (channel, frames[channel], frames[numChannels + channel]);
+                    const double second = downStages[1].down (channel, frames[numChannels*2 + channel], frames[numChannels*3 + channel]);
+                    y = downStages[0].down (channel, first, second);
+                }
+
+                channels[channel][offset + sample] = (SampleType) y;
+            }
+
+            // channels that weren't given still run through the filters, as the engine's lanes do
+            for (int channel = numChannelsToProcess; channel < numChannels && factor > 1; ++channel)
+            {
+                if (factor == 2)
+                {
+                    downStages[0].down (channel, frames[channel], frames[numChannels + channel]);
+                }
+                else
+                {
+                    const double first = downStages[1].down (channel, frames[channel], frames[numChannels + channel]);
+                    const double second = downStages[1].down (channel, frames[numChannels*2 + channel], frames[numChannels*3 + channel]);
+                    downStages[0].down (channel, first, second);
+                }
+            }
+        }
+
+        numSilentSamples = wroteSound ? 0 : std::min (numSilentSamples + numSamples*factor, std::numeric_limits<int>::max()/2);
+    }
+
+    /** Runs one kernel sample for every channel, replacing each input in io with its output. */
+    void processFrame (double* io) noexcept
+    {
+        float values[numRamps];
+        for (int i = 0; i < numRamps; ++i)
+            values[i] = ramps[i].next();
+
+        float quadrature;
+        const float lfo = nextLfo (quadrature);
+        const int minWholeDelay = interpolation == InterpolationQuality::sinc ? 1 : 0;
+        const double positionOffset = interpolation == InterpolationQuality::allpass ? 0.5 : 0.0;
+        const double minPosition = std::min ((double) minWholeDelay, (double) maxDelaySamples);
+        const float delay = std::min (std::max (values[delayRamp], 0.0f), maxDelaySamples);
+        const float gain = 1.0f + values[tremoloRamp]*(lfo - 1.0f);
+        int wholeDelays[maxCombVoices];
+        float fractions[maxCombVoices], voiceGains[maxCombVoices];
+
+        for (int v = 0; v < maxCombVoices; ++v)
+        {
+            float coefficients[VoiceRamp::numCoefficients];
+            voices[v].next (coefficients);
+
+            const float c = coefficients[VoiceRamp::cosine], s = coefficients[VoiceRamp::sine];
+            const float voiceLfo = lfo*c + quadrature*s + 0.5f*(1.0f - c);
+            const float modulation = std::min (std::max (values[widthRamp]*coefficients[VoiceRamp::depth]*voiceLfo, -maxDelaySamples), maxDelaySamples);
+            const double position = std::min (std::max ((double) delay + (double) modulation, minPosition), (double) maxDelaySamples)
+                                  + positionOffset;
+            wholeDelays[v] = (int) position;
+            fractions[v] = (float) (position - (double) wholeDelays[v]);
+            voiceGains[v] = coefficients[VoiceRamp::gain];
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            double delayed = 0.0;
+
+            for (int v = 0; v < maxCombVoices; ++v)
+            {
+                const double voiceTap = readDelayed (channel, v, minDelaySamples + wholeDelays[v], fractions[v]);
+
+                if (voiceGains[v] != 0.0f)
+                    delayed += (double) voiceGains[v]*voiceTap;
+            }
+
+            const double xh = io[channel] + (double) values[feedbackRamp]*delayed;
+            const double y = (double) values[bleedRamp]*xh + (double) values[feedforwardRamp]*delayed;
+
+            history[(size_t) channel][(size_t) writeIndex] = xh;
+            wroteSound = wroteSound || std::abs (xh) >= silenceThreshold;
+            io[channel] = (double) gain*y;
+        }
+
+        // a silent voice's allpass state follows the first voice's
+        for (int v = 1; v < maxCombVoices; ++v)
+            if (voices[v].isSilent())
+                std::copy (allpassState.begin(), allpassState.begin() + numChannels, allpassState.begin() + v*numChannels);
+
+        writeIndex = (writeIndex + 1) % historyLength;
+    }
+
+    /** Limits delays to maxDelay, and to the history prepare() was asked for. */
+    void updateMaxDelaySamples() noexcept
+    {
+        const double longestDelay = (double) (historyLength - minDelaySamples - maxTaps - 2);
+        maxDelaySamples = (float) std::max (0.0, std::min (std::max (0.0, (double) params.maxDelay)*sampleRate, longestDelay));
+    }
+
+    /** Sample from delay samples ago, where delay 0 is the one about to be written. */
+    double tap (int channel, int delay) const noexcept
+    {
+        return history[(size_t) channel][(size_t) ((writeIndex - delay + historyLength*2) % historyLength)];
+    }
+
+    double readDelayed (int channel, int voice, int delay, float fraction) noexcept
+    {
+        switch (interpolation)
+        {
+            case InterpolationQuality::cubic:
+            {
+                // taps from delay - 1 to delay + 2, with the nearest tabulated fraction
+                const float* weights = cubicTable.data() + (int) (fraction*(float) numPhases + 0.5f)*4;
+                double sum = 0.0;
+
+                for (int j = 0; j < 4; ++j)
+                    sum += (double) weights[j]*tap (channel, delay + 2 - j);
+
+                return sum;
+            }
+
+            case InterpolationQuality::allpass:
+            {
+                // y[n] = a*x[n] + x[n-1] - a*y[n-1], for a delay of 0.5 + fraction from delay - 1
+                const double d = 0.5 + (double) fraction;
+                const double a = (1.0 - d)/(1.0 + d);
+                double& state = allpassState[(size_t) (voice*numChannels + channel)];
+                const double y = tap (channel, delay) + a*(tap (channel, delay - 1) - state);
+                state = y;
+                return y;
+            }
+
+            case InterpolationQuality::sinc:
+            {
+                // taps from delay - 3 to delay + 4, between the two nearest tabulated fractions
+                const float position = fraction*(float) numPhases;
+                const int row = std::min ((int) position, numPhases - 1);
+                const float t = position - (float) row;
+                double sum = 0.0;
+
+                for (int j = 0; j < 8; ++j)
+                {
+                    const float w0 = sincTable[(size_t) (row*8 + j)], w1 = sincTable[(size_t) ((row + 1)*8 + j)];
+                    sum += (double) (w0 + t*(w1 - w0))*tap (channel, delay + 4 - j);
+                }
+
+                return sum;
+            }
+
+            case InterpolationQuality::linear:
+            case InterpolationQuality::numQualities:
+            default:
+            {
+                const double newer = tap (channel, delay), older = tap (channel, delay + 1);
+                return newer + (double) fraction*(older - newer);
+            }
+        }
+    }
+
+    /** Returns the LFO and sets quadrature to 0.5*cos(2*pi*phase), then advances the phase. */
+    float nextLfo (float& quadrature) noexcept
+    {
+        quadrature = (float) (0.5*std::cos (twoPi*phase));
+        const float value = (float) (0.5 + 0.5*std::sin (twoPi*phase));
+        const double frequency = std::max (0.0, (double) params.lfoFreq);
+
+        if (frequency > 0.0)
+            phase += frequency/sampleRate;
+        else if (phase > parkedPhase)
+            phase += drainFrequency/sampleRate;
+
+        phase -= std::floor (phase);
+        return value;
+    }
+
+    //==============================================================================
+    /** Rows of numTaps weights, oldest tap first, for fractions k/numPhases,
+        normalised to unity gain at DC and to a peak gain of at most 1.
+    */
+    template <typename WeightFn>
+    static std::vector<float> buildTable (int numTaps, int numNewerTaps, WeightFn&& weightFn)
+    {
+        std::vector<float> table ((size_t) ((numPhases + 1)*numTaps));
+        std::vector<double> row ((size_t) numTaps);
+
+        for (int phaseIndex = 0; phaseIndex <= numPhases; ++phaseIndex)
+        {
+            const double fraction = (double) phaseIndex/numPhases;
+            double sum = 0.0, maxGain = 0.0;
+
+            for (int j = 0; j < numTaps; ++j)
+                sum += (row[(size_t) j] = weightFn ((double) (numTaps - 1 - numNewerTaps - j), fraction));
+
+            for (int bin = 0; bin <= 256; ++bin)
+            {
+                const double w = pi*bin/256.0;
+                double re = 0.0, im = 0.0;
+
+                for (int j = 0; j < numTaps; ++j)
+                {
+                    re += row[(size_t) j]/sum*std::cos (w*j);
+                    im -= row[(size_t) j]/sum*std::sin (w*j);
+                }
+
+                maxGain = std::max (maxGain, std::sqrt (re*re + im*im));
+            }
+
+            for (int j = 0; j < numTaps; ++j)
+                table[(size_t) (phaseIndex*numTaps + j)] = (float) (row[(size_t) j]*(1.0/(sum*std::max (1.0, maxGain))));
+        }
+
+        return table;
+    }
+
+    void buildTables()
+    {
+        cubicTable = buildTable (4, 1, [] (double tapDelay, double fraction)
+        {
+            double w = 1.0;
+
+            for (int k = -1; k <= 2; ++k)
+                if (k != (int) tapDelay)
+                    w *= (fraction - k)/(tapDelay - k);
+
+            return w;
+        });
+
+        sincTable = buildTable (8, 3, [] (double tapDelay, double fraction)
+        {
+            const double x = fraction - tapDelay, r = x/4.0;
+
+            if (std::abs (r) >= 1.0)
+                return 0.0;
+
+            const double value = x == 0.0 ? 1.0 : std::sin (pi*0.9*x)/(pi*0.9*x);
+            return value*besselI0 (7.0*std::sqrt (1.0 - r*r))/besselI0 (7.0);
+        });
+    }
+
+    static double besselI0 (double x) noexcept
+    {
+        double sum = 1.0, term = 1.0;
+
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x/(2.0*k))*(x/(2.0*k));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    static constexpr double pi = 3.141592653589793, twoPi = 6.283185307179586;
+
+    CombParameters params;
+    InterpolationQuality interpolation = InterpolationQuality::linear;
+    double hostSampleRate = 44100.0, sampleRate = 44100.0;     // sampleRate is the kernel rate
+    double phase = 0.0;
+    float maxDelaySamples = 0.0f;
+    int factor = 1, maxFactor = 4;
+    int numChannels = 1, historyLength = 1, writeIndex = 0, numSilentSamples = 0;
+    bool idle = false, snapRamps = true, wroteSound = false;
+    HalfBandStage upStages[2], downStages[2];
+    std::vector<double> kernelFrames;
+    Ramp ramps[numRamps];
+    VoiceRamp voices[maxCombVoices];
+    std::vector<std::vector<double>> history;
+    std::vector<double> allpassState;
+    std::vector<float> cubicTable, sincTable;
+};
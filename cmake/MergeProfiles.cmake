@@ -0,0 +1,17 @@
+# Merges the raw profiles written by a Clang -fprofile-generate build into the
+# default.profdata that COMB_PGO=use reads.
+#
+#   cmake -DLLVM_PROFDATA=<llvm-profdata> -DPROFILE_DIR=<dir> -P MergeProfiles.cmake
+
+file (GLOB rawProfiles "${PROFILE_DIR}/*.profraw")
+
+if (NOT rawProfiles)
+    message (FATAL_ERROR "No raw profiles found in ${PROFILE_DIR}")
+endif()
+
+execute_process (COMMAND "${LLVM_PROFDATA}" merge "-output=${PROFILE_DIR}/default.profdata" ${rawProfiles}
+                 RESULT_VARIABLE result)
+
+if (NOT result EQUAL 0)
+    message (FATAL_ERROR "llvm-profdata failed to merge the profiles")
+endif()